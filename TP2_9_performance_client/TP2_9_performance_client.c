@@ -0,0 +1,6188 @@
+// TP2_9_performance_client.c
+
+/*
+    Changes from the previous code:
+
+    - Added new constants (OPCODE_ERROR, OPCODE_OACK, DEFAULT_BLOCK_SIZE, MAX_BLOCK_SIZE, HEADER_SIZE, HISTOGRAM_*).
+    - Added command-line options (-p port, -b blksize, -q quiet) parsed with getopt in parseCmdArgs.
+    - Added new functions (buildRequestPacket, receivePacket, receiveACK, parseOACK, handleErrorPacket).
+    - Modified functions (receiveFile, sendFile) to answer the server transfer ID and honour the negotiated block size.
+    - Added a per-block latency histogram (recordLatency, displayLatencyHistogram) dumped at the end or on SIGUSR1.
+    - Added phase timings (beginPhases, markPhase, displayPhaseTimings) and a batch mode (-n runs) with an aggregated summary.
+    - Added a preallocated capture ring (-w file) that records every datagram and is flushed as a pcap file at exit.
+    - Added new function (sendPacket) so that every datagram sent goes through a single place.
+    - Added a receive timeout (TIMEOUT_MS) with retransmission of the last ACK/DATA and detection of duplicate DATA blocks.
+    - Added a trace replay mode (replay action) that re-drives the requests, gaps and losses of a pcap file and compares the results.
+    - Added a load mode (-c clients, -r rate) running concurrent synthetic clients and reporting transfers/s, errors and latencies.
+    - Added block number rollover (nextBlockNumber) so that transfers are no longer capped at 65535 blocks, with -R to request rollover to 0 or 1.
+    - Added the windowsize option (-W, RFC 7440), an RTT estimator driving the retransmission timeout in sendFile,
+      and an adaptive AIMD in-flight window (-A) bounded by the negotiated windowsize.
+    - Added a reorder buffer to receiveFile: blocks ahead of the expected one (within the window) are kept
+      and written once the gap is filled, duplicates are dropped.
+    - Added a send ring to sendFile: the DATA packets in flight stay in memory so that a partial or duplicate ACK
+      resends the blocks after the acknowledged one immediately, without re-reading the file.
+    - Added DATA pacing in sendFile (-P) at the window rate over the smoothed RTT and a bandwidth cap (-B),
+      using SO_TXTIME departure times where available and a user-space token bucket otherwise.
+    - Modified function (createSocket) to size SO_RCVBUF/SO_SNDBUF from windowsize x blksize and count receive queue
+      drops (SO_RXQ_OVFL), with a busy-poll mode (-L) spinning on the socket before blocking.
+    - Added kernel receive timestamps (SO_TIMESTAMPING, NIC stamps recorded raw when provided) so that RTT samples and
+      block intervals exclude the client wake-up delay, which is reported separately (wakeupHistogram).
+    - Added hedged requests (hedgedGet): host may be a comma-separated list of mirrors, and a get that has no first
+      response after the -H percentile of previous first responses is duplicated to the next mirror.
+    - Added a server pool (-F alternate): every address of host and of the alternates gets a health entry (RTT, failures,
+      throughput), each transfer goes to the fastest healthy server and a failed one is retried later with backoff.
+    - Modified AI_FAMILY to AF_UNSPEC: a host with several addresses races its first request across them, IPv6 and IPv4
+      interleaved (happyEyeballs, RFC 8305), and addresses are passed with their real length (addressLength).
+    - Added a session cache (-T ttl): resolutions are reused for ttl seconds and sockets are pre-created between runs,
+      so that back-to-back transfers skip getaddrinfo and the socket setup.
+    - Added a streaming get (-o output): the received file goes to a path, stdout (-) or an open descriptor (&fd)
+      through a 1 MiB output buffer (openOutput), and the messages move to stderr when the data uses stdout.
+    - Added a streaming put (-i input): the file is read from a path, stdin (-) or an open descriptor (&fd) of unknown
+      length (openInput), straight into the send ring, and the final block is the first short read at end of stream.
+    - Added inline decompression of downloads (-z): gzip, zstd or xz data, recognized from the first block, is piped
+      to a decompressor process that runs alongside the transfer loop (startDecompressor, finishDecompressor).
+    - Added streaming integrity checks (-V): a CRC32C or SHA-256 digest of the payload is computed block by block (with
+      the SSE4.2 and SHA instructions when the CPU has them) and compared with an expected value or a sidecar file.
+    - Added sparse files (-S): all-zero blocks (isZeroBlock, SSE2) become holes in a downloaded file, and the holes of
+      an uploaded file are found with SEEK_DATA/SEEK_HOLE and sent as zeros without reading them (readSparseBlock).
+    - Added the netascii mode (-m netascii): newlines are translated to CR LF and CR to CR NUL on put, and back on get,
+      scanning 16 bytes at a time for CR/LF (findLineBreak) and carrying the pairs split across blocks.
+    - Added a caching relay (action relay, -l port): RRQs from downstream clients are served from a cache directory, and
+      a missing file is fetched once from the upstream server by a child process while its requests wait (runRelay).
+    - Added a content cache for get (-C dir): a cached copy is only re-used when a tsize probe reports the same size
+      (conditionalGet), with a reflink, a hard link or a copy, and each new download is stored with its size and digests.
+    - Added a server mode (action serve, -j workers) sharing the relay engine (runServer): an epoll loop per worker, one
+      socket per transfer, DATA sent from mapped files kept for the next requests (openHotFile) and uploads with options.
+*/
+
+// -------------------- Header -------------------- //
+// Libraries
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <sys/ioctl.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// Constants
+#define TFTP_SERVER_PORT "69"       // Default port number for TFTP server
+#define AI_FAMILY AF_UNSPEC         // Resolve both IPv6 and IPv4 addresses
+#define AI_SOCKTYPE SOCK_DGRAM      // Datagram socket type for UDP
+#define AI_PROTOCOL IPPROTO_UDP     // UDP protocol for socket
+#define AI_FLAGS 0                  // No special flags for getaddrinfo function
+#define OPCODE_RRQ 1                // TFTP opcode for Read Request
+#define OPCODE_WRQ 2                // TFTP opcode for Write Request
+#define OPCODE_DATA 3               // TFTP opcode for Data Packet
+#define OPCODE_ACK 4                // TFTP opcode for Acknowledgment
+#define OPCODE_ERROR 5              // TFTP opcode for Error Packet
+#define OPCODE_OACK 6               // TFTP opcode for Option Acknowledgment (RFC 2347)
+#define TRANSFER_MODE "octet"       // Default transfer mode for file transfer
+#define NETASCII_MODE "netascii"    // Text transfer mode (CR LF newlines, CR NUL for a bare CR)
+#define SENDTO_FLAGS 0              // No special flags for the sendto function
+#define RECVFROM_FLAGS 0            // No special flags for the recvfrom function
+#define BLOCK_OPTION "blksize"      // TFTP option for specifying block size
+#define BLOCK_SIZE "1024"           // Default block size in ASCII
+#define ROLLOVER_OPTION "rollover"  // TFTP option for the block number following 65535
+#define WINDOW_OPTION "windowsize"  // TFTP option for the number of blocks sent per ACK (RFC 7440)
+#define TSIZE_OPTION "tsize"        // TFTP option for the transfer size (RFC 2349)
+#define TIMEOUT_OPTION "timeout"    // TFTP option for the retransmission timeout in seconds (RFC 2349)
+#define MAX_WINDOW_SIZE 256         // Largest windowsize requested by the client
+#define DEFAULT_BLOCK_SIZE 512      // Block size used when the server ignores BLOCK_OPTION
+#define MIN_BLOCK_SIZE 8            // Smallest block size allowed by RFC 2348
+#define MAX_BLOCK_SIZE 65464        // Largest block size allowed by RFC 2348
+#define HEADER_SIZE 4               // Opcode (2 bytes) + block number (2 bytes)
+#define HISTOGRAM_SUB_BITS 5        // Linear sub-buckets per power of two (2^5 = 32, ~3% precision)
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)       // Received data coalesced per write to the output file or stream
+#define INPUT_BUFFER_SIZE (1024 * 1024)        // Data read ahead of the send ring from the input file or stream
+#define DIGEST_NONE 0                          // No integrity check
+#define DIGEST_CRC32C 1                        // CRC32C (Castagnoli), 8 hexadecimal digits
+#define DIGEST_SHA256 2                        // SHA-256, 64 hexadecimal digits
+#if defined(__linux__) && !defined(SEEK_DATA)
+#define SEEK_DATA 3                            // Next data region of a sparse file (Linux value, needs _GNU_SOURCE)
+#define SEEK_HOLE 4                            // Next hole of a sparse file
+#endif
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)             // Share the blocks of another file (reflink, from linux/fs.h)
+#endif
+#define NETASCII_CHUNK_SIZE 4096               // Local bytes translated per read in netascii mode
+#define CAPTURE_RING_SIZE (16 * 1024 * 1024)   // Memory preallocated for the capture ring (bytes)
+#define CAPTURE_SNAPLEN 128                     // UDP payload bytes kept per captured datagram
+#define CAPTURE_MAX_SOCKETS 4096                // Descriptors whose local endpoint is remembered (above, it is read for each datagram)
+#define CAPTURE_ROUTE_CACHE 16                  // Peers whose route source is remembered, for sockets bound to the wildcard address
+#define PCAP_MAGIC_NANO 0xa1b23c4d              // pcap magic number for nanosecond timestamps
+#define PCAP_LINKTYPE_RAW 101                   // pcap link type for raw IPv4/IPv6 packets
+#define PCAP_MAGIC_MICRO 0xa1b2c3d4             // pcap magic number for microsecond timestamps
+#define PCAP_LINKTYPE_NULL 0                    // pcap link type for BSD loopback
+#define PCAP_LINKTYPE_ETHERNET 1                // pcap link type for Ethernet
+#define PCAP_LINKTYPE_LINUX_SLL 113             // pcap link type for Linux cooked capture
+#define TIMEOUT_MS 1000                 // Time to wait for a packet before retransmitting (before any RTT sample)
+#define MIN_TIMEOUT_MS 20               // Lower bound of the RTT-based retransmission timeout
+#define MAX_TIMEOUT_MS 5000             // Upper bound of the RTT-based retransmission timeout
+#define ACK_DELAY_US 2000               // Idle time after which a window receiver acknowledges a partial window
+#define MAX_RETRIES 5                   // Retransmissions before giving up on a transfer
+#define PACING_GAIN 1.25                // Pacing rate above window / RTT, so that pacing never limits a clean window
+#define PACING_BURST_PACKETS 2          // Token bucket depth (packets that may leave back to back)
+#define BUSY_POLL_US 1000               // Time spent polling the socket before blocking in busy-poll mode (-L)
+#define PACING_HORIZON_US 1000          // How far ahead of their departure time packets are handed to the kernel (SO_TXTIME)
+#define REPLAY_MAX_TRANSFERS 1024       // Transfers loaded from a trace
+#define REPLAY_MAX_LOSSES 256           // Losses replayed per transfer
+#define MAX_MIRRORS 8                   // Mirrors accepted in a comma-separated host list
+#define HEDGE_DEFAULT_MS 50             // Hedge delay until enough first responses have been measured
+#define HEDGE_MIN_SAMPLES 20            // First responses needed before the hedge delay follows the percentile
+#define HEDGE_PERCENTILE 95.0           // Default percentile of the first response latency used as hedge delay (-H)
+#define HAPPY_EYEBALLS_DELAY_MS 250     // Connection Attempt Delay before the request goes to the next address (RFC 8305)
+#define MAX_SERVERS 16                  // Entries in the server pool (addresses of host and alternates)
+#define FAILOVER_BACKOFF_MS 1000        // Time a failed server is avoided, doubled after each further failure
+#define FAILOVER_MAX_BACKOFF_MS 60000   // Upper bound of the failover backoff
+#define FAILOVER_RETRIES 3              // Attempts of a transfer once every server of the pool failed it
+#define ERROR_CODE_UNDEFINED 0          // TFTP error code "Not defined, see error message"
+#define ERROR_CODE_NOT_FOUND 1          // TFTP error code "File not found"
+#define ERROR_CODE_ACCESS 2             // TFTP error code "Access violation"
+#define ERROR_CODE_DISK_FULL 3          // TFTP error code "Disk full or allocation exceeded"
+#define ERROR_CODE_ILLEGAL 4            // TFTP error code "Illegal TFTP operation"
+#define ERROR_CODE_UNKNOWN_TID 5        // TFTP error code "Unknown transfer ID"
+#define REQUEST_MAX_SIZE 512            // Largest RRQ/WRQ accepted (RFC 2347)
+#define SERVER_MAX_SESSIONS 1024        // Transfers served at the same time by a server or relay worker
+#define SERVER_MAX_EVENTS 64            // Events read from epoll per wakeup
+#define HOT_CACHE_SIZE SERVER_MAX_SESSIONS  // Mapped files kept per worker (one per transfer at most)
+#define RELAY_MAX_FETCHES 32            // Upstream fetches in progress at the same time
+#define RELAY_INITIAL_WAITERS 64        // Room for the downstream requests waiting for a fetch (doubled when full)
+#define RELAY_FETCH_POLL_MS 20          // Interval at which finished fetches are collected
+#define CACHE_COPY_SIZE (64 * 1024)     // Bytes copied per read when a cached file can be neither cloned nor linked
+#define RESOLVER_TTL_S 30               // Default lifetime of a cached resolution (-T)
+#define RESOLVER_CACHE_SIZE 16          // Resolutions kept by the session cache
+#define SOCKET_POOL_SIZE 4              // Pre-created sockets kept by the session cache
+#define USAGE "Usage: [-p port] [-b blksize] [-R 0/1] [-W windowsize] [-A] [-P] [-B bytes/s] [-L] [-H percentile] [-F alternate] [-T ttl] [-o output] [-i input] [-z] [-V digest] [-S] [-m mode] [-l port] [-C cache] [-j workers] [-n runs] [-c clients] [-r rate] [-w capture.pcap] [-q] <host[,mirror...]> <file> <get/put/replay/relay/serve>"
+
+// Transfer phases, in the order they complete
+enum Phase {
+    PHASE_PARSE,                    // parseCmdArgs
+    PHASE_RESOLVE,                  // getAddressInfo (DNS)
+    PHASE_SOCKET,                   // createSocket
+    PHASE_REQUEST,                  // RRQ/WRQ sent
+    PHASE_FIRST_RESPONSE,           // First DATA/OACK (get) or ACK/OACK (put) received
+    PHASE_STEADY,                   // Remaining blocks transferred
+    PHASE_CLOSE,                    // File closed and resources released
+    PHASE_COUNT
+};
+
+// Structure definitions
+struct ACKPacket {
+    uint16_t opcode;                // Operation code
+    uint16_t blockNumber;           // Block number
+};
+
+struct ClientOptions {
+    const char *port;               // Server port (-p)
+    const char *blockSize;          // Requested block size in ASCII (-b)
+    const char *rollover;           // Requested rollover block (0 or 1) in ASCII, NULL when not requested (-R)
+    const char *windowSize;         // Requested windowsize in ASCII, NULL when not requested (-W)
+    int adaptiveWindow;             // Adapt the in-flight window with AIMD (-A)
+    int pacing;                     // Spread DATA packets over the RTT (-P)
+    double bandwidthCap;            // Upper bound of the sending rate in bytes per second, 0 for none (-B)
+    int busyPoll;                   // Spin on the socket instead of sleeping in recvmsg (-L)
+    double hedgePercentile;         // Percentile of the first response latency after which a mirror is tried (-H)
+    const char *alternates[MAX_SERVERS];    // Alternate servers added to the pool (-F, repeatable)
+    int alternateCount;             // Number of alternate servers
+    int sessionTTL;                 // Seconds a resolution is reused, 0 to disable the session cache (-T)
+    const char *output;             // Local destination of a get: path, - for stdout or &fd, NULL for the remote name (-o)
+    const char *input;              // Local source of a put: path, - for stdin or &fd, NULL for the remote name (-i)
+    int decompress;                 // Decompress gzip, zstd and xz downloads on the fly (-z)
+    const char *verify;             // Expected digest in hexadecimal, @sidecar file, or crc32c/sha256 to print it (-V)
+    int sparse;                     // Write zero blocks as holes (get) and skip reading holes (put) (-S)
+    const char *mode;               // Transfer mode, octet or netascii (-m)
+    const char *listenPort;         // Local port of the relay and the server (-l)
+    const char *contentCache;       // Directory of the content cache for get (-C)
+    int workers;                    // Server or relay processes sharing the port (-j)
+    int quiet;                      // Suppress debug output (-q)
+    int runs;                       // Number of back-to-back transfers (-n)
+    const char *capturePath;        // pcap file written from the capture ring (-w)
+    int clients;                    // Concurrent synthetic clients in load mode, 0 when disabled (-c)
+    double rate;                    // Total requests per second in load mode, 0 for unpaced (-r)
+};
+
+struct TransferOptions {
+    int blockSize;                  // Block size acknowledged by the server
+    uint16_t rollover;              // Block number following 65535
+    int windowSize;                 // Blocks sent per ACK acknowledged by the server
+    long long transferSize;         // File size announced with tsize, -1 when unknown
+};
+
+struct RTTEstimator {
+    uint64_t smoothedRTT;           // Smoothed round-trip time, 0 before the first sample (ns)
+    uint64_t rttVariation;          // Round-trip time variation (ns)
+    uint64_t timeout;               // Retransmission timeout (ns)
+};
+
+struct WindowController {
+    int ceiling;                    // Negotiated windowsize
+    int congestionWindow;           // Blocks allowed in flight
+    uint64_t decreases;             // Timeouts and loss signals that shrank the window
+    uint64_t retransmissions;       // DATA packets sent more than once
+};
+
+struct ServerHealth {
+    const struct addrinfo *address;         // Resolved address (owned by the pool lists)
+    char name[INET6_ADDRSTRLEN];            // Printable address
+    uint64_t smoothedRTT;                   // Smoothed request-to-first-response time, 0 before the first success (ns)
+    double throughput;                      // Throughput of the last successful transfer (bytes per second)
+    int failures;                           // Consecutive failures
+    uint64_t retryAt;                       // Monotonic time before which the server is avoided
+    uint64_t transfers;                     // Successful transfers
+};
+
+struct ServerPool {
+    int count;                              // Servers in the pool
+    struct ServerHealth servers[MAX_SERVERS];
+    struct addrinfo *lists[MAX_SERVERS + 1];    // Resolution results of host and alternates
+    int listCount;
+};
+
+struct SocketStats {
+    int receiveBuffer;              // Effective SO_RCVBUF (bytes, as reported by the kernel)
+    int sendBuffer;                 // Effective SO_SNDBUF (bytes, as reported by the kernel)
+    int dropCounter;                // Whether the kernel reports receive queue drops (SO_RXQ_OVFL)
+    int kernelBusyPoll;             // Whether SO_BUSY_POLL was accepted
+    uint32_t drops;                 // Datagrams dropped because the receive queue was full
+    int timestamping;               // Receive timestamps taken by the kernel: 0 none, 1 software, 2 hardware seen
+    uint64_t lastReceivedAt;        // Arrival of the last packet on the monotonic clock (kernel timestamp when available)
+    uint64_t lastHardwareStamp;     // Raw NIC clock (PHC) time of the last packet, 0 when none (not comparable with system time)
+};
+
+struct ResolverEntry {
+    char host[256];
+    char port[16];
+    struct addrinfo *list;          // Resolution result, NULL for a free entry
+    uint64_t expiresAt;             // Monotonic time after which the host is resolved again
+    int users;                      // Transfers still using the list
+};
+
+struct SessionCache {
+    struct ResolverEntry entries[RESOLVER_CACHE_SIZE];
+    int sockets[SOCKET_POOL_SIZE];                      // Pre-created sockets waiting for the next transfers
+    int socketFamilies[SOCKET_POOL_SIZE];
+    struct SocketStats socketSettings[SOCKET_POOL_SIZE];   // Buffers and options applied to each of them
+    int socketCount;
+    int families[2];                // Address families used so far (IPv4, IPv6), 0 when unused
+    uint64_t resolverHits;
+    uint64_t resolverMisses;
+    uint64_t socketHits;
+    uint64_t socketMisses;
+};
+
+struct Pacer {
+    int enabled;                    // Pacing requested (-P) or rate capped (-B)
+    int kernelPacing;               // Departure times handed to the kernel (SO_TXTIME) instead of sleeping
+    double rate;                    // Current pacing rate (bytes per second), 0 while unknown
+    uint64_t nextDeparture;         // Earliest departure of the next packet (ns)
+    uint64_t sleeps;                // Waits in the user-space token bucket
+};
+
+struct SendRing {
+    char *packets;                          // One DATA packet (header + block) per slot
+    size_t lengths[MAX_WINDOW_SIZE];        // Length of the packet in each slot
+    int capacity;                           // Slots in use (negotiated windowsize)
+    int packetSize;                         // Size of a slot
+};
+
+struct ReorderBuffer {
+    char *data;                             // One block per slot, NULL until a block arrives out of order
+    size_t lengths[MAX_WINDOW_SIZE];        // Data length of each slot
+    unsigned char present[MAX_WINDOW_SIZE]; // Whether each slot holds a block
+    int capacity;                           // Slots in use (negotiated windowsize)
+    int blockSize;                          // Size of a slot
+    int head;                               // Slot of the next expected block
+    int buffered;                           // Blocks currently held
+    uint64_t reordered;                     // Blocks that arrived ahead of the expected one
+    uint64_t duplicates;                    // Blocks that arrived more than once
+};
+
+struct PhaseTimings {
+    uint64_t start;                 // Monotonic time at which the transfer started (ns)
+    uint64_t marks[PHASE_COUNT];    // Monotonic time at which each phase completed (ns)
+};
+
+struct PhaseSummary {
+    int runs;                               // Number of aggregated transfers
+    uint64_t total[PHASE_COUNT];            // Sum of each phase duration (ns)
+    uint64_t min[PHASE_COUNT];              // Shortest duration of each phase (ns)
+    uint64_t max[PHASE_COUNT];              // Longest duration of each phase (ns)
+};
+
+union CaptureAddress {
+    struct sockaddr sa;             // Generic view (family)
+    struct sockaddr_in ipv4;        // IPv4 address and port
+    struct sockaddr_in6 ipv6;       // IPv6 address and port
+};
+
+struct CaptureRecord {
+    uint64_t timestamp;                     // Monotonic time of the send or receive (ns)
+    union CaptureAddress sourceAddr;        // Sender of the datagram
+    union CaptureAddress destinationAddr;   // Receiver of the datagram
+    uint32_t length;                        // Original UDP payload length
+    uint32_t capturedLength;                // Payload bytes kept in the record
+    unsigned char payload[CAPTURE_SNAPLEN]; // Start of the UDP payload
+};
+
+struct CaptureSocket {
+    union CaptureAddress localAddr; // Local address and port of the descriptor
+    int known;                      // Read at the first datagram captured, cleared when the descriptor is closed or reused
+    int wildcard;                   // Bound to the wildcard address: the source address depends on the peer
+};
+
+struct CaptureRoute {
+    union CaptureAddress peer;      // Peer whose route was looked up
+    union CaptureAddress source;    // Source address chosen by the routing table for it
+};
+
+struct CaptureRing {
+    struct CaptureRecord *records;  // Preallocated records (NULL when capture is disabled)
+    size_t capacity;                // Number of records in the ring
+    uint64_t written;               // Number of datagrams captured so far
+    uint64_t clockOffset;           // Realtime minus monotonic clock, for pcap timestamps (ns)
+    struct CaptureSocket *sockets;  // Local endpoint of each descriptor below CAPTURE_MAX_SOCKETS
+    struct CaptureRoute routes[CAPTURE_ROUTE_CACHE];   // Route sources of the recent peers of wildcard sockets
+    int nextRoute;                  // Route replaced by the next lookup
+};
+
+struct LossSchedule {
+    uint16_t opcode;                        // Opcode of the packets to drop (OPCODE_ACK or OPCODE_DATA)
+    int count;                              // Number of scheduled losses (0 when disabled)
+    uint16_t blocks[REPLAY_MAX_LOSSES];     // Block numbers whose first transmission is dropped
+    int dropped[REPLAY_MAX_LOSSES];         // Set once the corresponding loss has been applied
+};
+
+struct LatencyHistogram {
+    _Atomic uint64_t counts[HISTOGRAM_BUCKETS];   // Samples per log-linear bucket
+    _Atomic uint64_t totalCount;                  // Number of recorded samples
+    _Atomic uint64_t maxValue;                    // Largest recorded sample (ns)
+};
+
+struct HedgeStats {
+    int mirrorCount;                        // Mirrors in the host list (hedging is enabled above 1)
+    char *mirrors[MAX_MIRRORS];             // Mirror host names, in the order they are tried
+    uint64_t transfers;                     // Hedged gets
+    uint64_t hedges;                        // Duplicate RRQs sent to a further mirror
+    uint64_t wins[MAX_MIRRORS];             // Transfers served by each mirror
+    struct LatencyHistogram firstResponse;  // RRQ-to-first-response latency of the winners
+};
+
+struct Digest {
+    int algorithm;                  // DIGEST_NONE, DIGEST_CRC32C or DIGEST_SHA256
+    uint32_t crc;                   // Running CRC32C (inverted)
+    uint32_t state[8];              // SHA-256 chaining value
+    uint8_t buffer[64];             // Bytes waiting for a complete SHA-256 block
+    size_t buffered;
+    uint64_t length;                // Bytes digested so far
+};
+
+struct DigestCheck {
+    int algorithm;                  // Digest computed for each transfer, DIGEST_NONE when disabled
+    char expected[65];              // Expected digest in lowercase hexadecimal, empty to only print it
+    int hardwareCRC;                // Whether the CPU has the SSE4.2 CRC32 instruction
+    int hardwareSHA;                // Whether the CPU has the SHA-256 instructions
+};
+
+struct SparseReader {
+    int enabled;                    // Regular file whose holes can be located (-S)
+    int fd;
+    off_t offset;                   // Offset of the next block
+    off_t size;                     // File size when the transfer started
+    off_t nextData;                 // Start of the data region at or after the last lookup
+    off_t nextHole;                 // End of that data region
+    int error;                      // Set when a read failed
+    uint64_t holeBlocks;            // Blocks produced from holes without reading
+    uint64_t holeBytes;
+};
+
+struct NetasciiEncoder {
+    uint8_t input[NETASCII_CHUNK_SIZE];     // Local bytes read from the file
+    size_t position;                        // Next byte to translate
+    size_t length;                          // Bytes in the input buffer
+    int pending;                            // Second byte of a CR LF / CR NUL pair left for the next block, -1 when none
+    struct Digest *digest;                  // Digest of the local bytes (-V), updated as they are read
+};
+
+struct NetasciiDecoder {
+    int pendingCR;                  // The previous block ended with a CR whose pair starts the next block
+};
+
+struct SentRequest {
+    char packet[REQUEST_MAX_SIZE];  // Last RRQ/WRQ sent, resent until the server answers
+    size_t length;                  // 0 when none (or too long to be kept)
+};
+
+struct RequestOptions {
+    int blockSize;                  // Requested option values, -1 when not requested
+    int windowSize;
+    int rollover;
+    int tsize;
+    int timeout;
+    int netascii;                   // Netascii rather than octet mode
+};
+
+struct ServerRequest {
+    struct sockaddr_storage peerAddr;       // Client (its transfer ID)
+    char packet[REQUEST_MAX_SIZE];          // RRQ/WRQ as received
+    size_t length;
+};
+
+struct HotFile {
+    char path[1024];                        // File mapped, empty for a free slot
+    dev_t device;                           // Version of the file mapped (a replaced or modified file is mapped again)
+    ino_t inode;
+    off_t size;
+    struct timespec mtime;
+    const char *data;                       // Read-only mapping, NULL for an empty file
+    int users;                              // Transfers sending from the mapping
+    uint64_t lastUsed;                      // Monotonic time of the last request, for the eviction
+};
+
+struct ServerSession {
+    int sockfd;                             // Socket of the transfer (its port is the server TID), -1 for a free slot
+    struct sockaddr_storage peerAddr;       // Client
+    int writing;                            // Upload (WRQ) rather than download (RRQ)
+    struct HotFile *hotFile;                // Mapped file being sent
+    int fd;                                 // Temporary file being received, -1 when none
+    char path[1024];                        // File served or replaced by the upload
+    off_t size;                             // Bytes sent (netascii once translated), or written so far by the upload
+    int netascii;                           // Netascii mode: the download is sent translated, the upload is translated back
+    char *netasciiData;                     // Netascii translation of the file sent, NULL when none
+    struct NetasciiDecoder decoder;         // Newline pairs split across the blocks of a netascii upload
+    struct TransferOptions transferOptions; // Options acknowledged to the client
+    uint64_t timeout;                       // Retransmission timeout in nanoseconds (timeout option)
+    char oack[REQUEST_MAX_SIZE];            // OACK kept for retransmission, until the ACK of block 0 or the first DATA
+    size_t oackLength;                      // 0 once the OACK is acknowledged (or when none was sent)
+    uint64_t baseSequence;                  // Oldest unacknowledged block (download) or next block expected (upload)
+    uint64_t nextSequence;                  // Next block to send
+    uint64_t lastSequence;                  // Final (short) block of a download
+    int pendingBlocks;                      // Blocks received since the last ACK of an upload
+    int gapAcknowledged;                    // The gap in front of the next block expected was already reported
+    int finished;                           // Upload complete, the final ACK is repeated until the client goes quiet
+    uint64_t deadline;                      // Retransmission time on the monotonic clock
+    int retries;
+};
+
+struct RelayFetch {
+    char filename[256];                     // File awaited, empty for a free slot
+    pid_t pid;                              // Child fetching the file from upstream, 0 when another worker fetches it
+    int waiterCount;
+    int waiterCapacity;
+    struct ServerRequest *waiters;          // Grown as requests arrive, kept for the next fetches of the slot
+};
+
+struct SharedFetch {
+    char filename[256];             // File fetched from upstream, empty for a free slot
+    pid_t worker;                   // Worker running the fetch
+};
+
+struct ServerStats {
+    _Atomic uint64_t requests;      // RRQs and WRQs accepted
+    _Atomic uint64_t hotHits;       // Downloads sent from a file already mapped
+    _Atomic uint64_t fetches;       // Files fetched from upstream (relay)
+    _Atomic uint64_t coalesced;     // RRQs that waited for a fetch already in progress (relay)
+    _Atomic uint64_t downloads;     // Downloads completed
+    _Atomic uint64_t uploads;       // Uploads completed
+    _Atomic uint64_t failures;      // Requests, fetches or transfers that failed
+    _Atomic uint64_t bytesSent;     // DATA payload sent (retransmissions included)
+    _Atomic uint64_t bytesReceived; // DATA payload written
+    atomic_flag fetchLock;          // Held while the fetch table is read or changed (relay)
+    struct SharedFetch fetchTable[RELAY_MAX_FETCHES];  // Fetches in progress in every worker, so that each file is fetched once (relay)
+};
+
+struct ContentCache {
+    int recording;                  // The transfer in progress is stored in the cache once complete
+    char path[1024];                // Cached copy: <cache>/<server address>_<port>/<file>
+    char metaPath[1100];            // Size, modification time and digests of the cached copy
+    int valid;                      // Metadata found and still matching the cached copy
+    long long size;
+    long long mtime;                // Modification time of the cached copy (ns), which changes if it is written through a hard link
+    char crc32c[65];
+    char sha256[65];
+    struct Digest crcDigest;        // Digests of the download being recorded
+    struct Digest shaDigest;
+    uint64_t hits;                  // Transfers skipped because the size matched
+    uint64_t misses;                // Transfers stored in the cache
+    uint64_t savedBytes;
+};
+
+struct LoadStats {
+    _Atomic uint64_t transfers;                 // Transfers completed by all synthetic clients
+    _Atomic uint64_t errors;                    // Transfers that failed
+    struct LatencyHistogram transferLatency;    // Request-to-completion time of each transfer
+    struct LatencyHistogram firstResponseLatency; // Request-to-first-response time of each transfer
+};
+
+struct ReplayTransfer {
+    uint16_t opcode;                        // OPCODE_RRQ or OPCODE_WRQ
+    char filename[256];                     // Remote file name
+    char blockSize[8];                      // Requested block size in ASCII (empty when not requested)
+    uint16_t clientPort;                    // Client port identifying the transfer in the trace
+    uint64_t requestTime;                   // Time of the request (ns)
+    uint64_t firstResponseTime;             // Time of the first server packet (ns)
+    uint64_t endTime;                       // Time of the last packet (ns)
+    uint64_t bytes;                         // Unique payload bytes transferred
+    int lastOutgoingBlock;                  // Highest block sent (-1 before the first)
+    int lastIncomingBlock;                  // Highest block received (-1 before the first)
+    uint64_t pendingSince;                  // Time of the last ACK (get) or DATA (put) sent (ns)
+    struct LossSchedule losses;             // Losses observed in the trace
+    struct LatencyHistogram latency;        // Per-block intervals observed in the trace
+};
+
+// Global Variables
+struct ClientOptions clientOptions = { TFTP_SERVER_PORT, BLOCK_SIZE, NULL, NULL, 0, 0, 0, 0, HEDGE_PERCENTILE, { NULL }, 0, RESOLVER_TTL_S, NULL, NULL, 0, NULL, 0, TRANSFER_MODE, TFTP_SERVER_PORT, NULL, 1, 0, 1, NULL, 0, 0 };
+struct LatencyHistogram blockLatency;               // DATA-to-ACK (put) or ACK-to-DATA (get) intervals
+struct LatencyHistogram wakeupLatency;              // Kernel receive timestamp to recvmsg return (client scheduling)
+volatile sig_atomic_t statsRequested = 0;           // Set by the SIGUSR1 handler
+struct PhaseTimings currentPhases;                  // Phase timestamps of the transfer in progress
+struct PhaseSummary phaseSummary;                   // Phase durations aggregated across runs
+struct CaptureRing captureRing;                     // Datagrams captured for the pcap file
+struct LossSchedule lossSchedule;                   // Losses injected by the replay mode
+struct SocketStats socketStats;                     // Buffers and drops of the transfer socket
+struct HedgeStats hedgeStats;                       // Mirrors and outcome of the hedged requests
+struct ServerPool serverPool;                       // Health table of the servers able to serve a transfer
+struct SessionCache sessionCache;                   // Resolutions and sockets kept for the next transfers
+int streamFd = -1;                                  // Original stdout when the received data is streamed to it (-o -)
+struct DigestCheck digestCheck;                     // Integrity check applied to each transfer
+struct SentRequest lastRequest;                     // Request of the transfer in progress, for its retransmission
+uint64_t transferredBytes = 0;                      // Payload of the last transfer (each block once, as sent or received)
+struct ServerSession serverSessions[SERVER_MAX_SESSIONS];  // Transfers of the server or relay worker
+struct HotFile hotFiles[HOT_CACHE_SIZE];            // Files mapped by the worker, kept for the next downloads
+struct ServerStats *serverStats;                    // Requests served, shared by the workers
+int serverEpoll = -1;                               // Event loop of the worker
+const char *serverRoot;                             // Directory served (the cache directory of a relay)
+const char *relayUpstream;                          // Upstream server of a relay, NULL for a server
+struct RelayFetch relayFetches[RELAY_MAX_FETCHES];  // Upstream fetches of the relay and the requests waiting for them
+struct ContentCache contentCache;                   // Cached copy of the current download and the cache statistics
+volatile sig_atomic_t stopRequested = 0;            // Set by SIGINT/SIGTERM to stop the server or relay
+jmp_buf *errorJump = NULL;                          // Set by a synthetic client so that errors do not exit
+const char *phaseNames[PHASE_COUNT] = {
+    "parseCmdArgs", "getAddressInfo", "createSocket", "sendRequest", "firstResponse", "steadyState", "close"
+};
+
+// Helper Functions
+void processUserInput(int sockfd, struct addrinfo *serverAddr, const char *action, const char *file);
+void handle_error(const char *location, const char *message, const char *perror_message);
+void cleanup(struct addrinfo *serverAddr, int sockfd, char *rrqPacket, char *wrqPacket);
+const char* outputPath(const char *file);
+void redirectMessages();
+FILE* openOutput(const char *filename);
+const char* inputPath(const char *file);
+int isStream(const char *filename);
+FILE* openInput(const char *filename);
+FILE* startDecompressor(FILE *output, const char *block, size_t length, pid_t *decompressor);
+void finishDecompressor(pid_t decompressor);
+uint64_t monotonicNanoseconds();
+socklen_t addressLength(const struct sockaddr *address);
+const char* addressToString(const struct sockaddr *address, char *buffer, size_t size);
+ssize_t sendPacket(int sockfd, const void *packet, size_t length, const struct sockaddr *peerAddr);
+ssize_t sendPacketAt(int sockfd, const void *packet, size_t length, const struct sockaddr *peerAddr, uint64_t departure);
+ssize_t receivePacket(int sockfd, void *buffer, size_t length, struct sockaddr_storage *peerAddr);
+ssize_t spinReceive(int sockfd, struct msghdr *message);
+void readControlMessages(struct msghdr *message);
+int isTimeout(ssize_t result);
+int shouldDropPacket(const void *packet, size_t length);
+int parseOACK(const char *packet, ssize_t length, struct TransferOptions *transferOptions);
+void handleErrorPacket(const char *location, const char *packet, ssize_t length);
+void formatErrorPacket(const char *packet, ssize_t length, char *message, size_t size);
+uint16_t nextBlockNumber(uint16_t blockNumber, const struct TransferOptions *transferOptions);
+void initTransferOptions(struct TransferOptions *transferOptions);
+
+// Latency Functions
+void recordLatency(struct LatencyHistogram *histogram, uint64_t nanoseconds);
+uint64_t latencyPercentile(const struct LatencyHistogram *histogram, double percentile);
+void handleStatsSignal(int signum);
+void installStatsSignalHandler();
+void checkStatsRequest();
+
+// Capture Functions
+void initCaptureRing();
+void capturePacket(int sockfd, int outgoing, const void *packet, size_t length, const struct sockaddr *peerAddr);
+void forgetCaptureSocket(int sockfd);
+const union CaptureAddress* captureRouteSource(const struct sockaddr *peerAddr);
+int sameHost(const struct sockaddr *first, const struct sockaddr *second);
+void flushCaptureRing();
+
+// Replay Functions
+int loadTrace(const char *tracePath, struct ReplayTransfer **transfers);
+void addTracePacket(struct ReplayTransfer *transfers, int *count, uint64_t timestamp, uint16_t sourcePort, uint16_t destinationPort, const unsigned char *payload, size_t capturedLength, size_t length);
+void replayTrace(const struct addrinfo *serverAddr, const char *tracePath);
+
+// Window Functions
+int waitReadable(int sockfd, uint64_t timeout);
+void initRTTEstimator(struct RTTEstimator *estimator);
+void updateRTTEstimator(struct RTTEstimator *estimator, uint64_t sample);
+void backoffRTTEstimator(struct RTTEstimator *estimator);
+void initWindowController(struct WindowController *window, int ceiling);
+void growWindow(struct WindowController *window);
+void shrinkWindow(struct WindowController *window);
+uint16_t blockFromSequence(uint64_t sequence, const struct TransferOptions *transferOptions);
+int sequenceFromBlock(uint16_t blockNumber, uint64_t first, uint64_t last, const struct TransferOptions *transferOptions, uint64_t *sequence);
+int blockDistance(uint16_t from, uint16_t to, const struct TransferOptions *transferOptions);
+void initPacer(struct Pacer *pacer, int sockfd);
+void updatePacingRate(struct Pacer *pacer, const struct WindowController *window, const struct RTTEstimator *estimator, int packetSize);
+uint64_t paceDeparture(struct Pacer *pacer, size_t length);
+void initSendRing(struct SendRing *ring, int capacity, int blockSize);
+char* sendRingSlot(struct SendRing *ring, uint64_t sequence);
+void freeSendRing(struct SendRing *ring);
+void initReorderBuffer(struct ReorderBuffer *buffer, int capacity, int blockSize);
+void storeReorderBlock(struct ReorderBuffer *buffer, int distance, const char *data, size_t length);
+int nextReorderBlock(struct ReorderBuffer *buffer, const char **data, size_t *length);
+void freeReorderBuffer(struct ReorderBuffer *buffer);
+
+// Mirror Functions
+void parseMirrors(char *hostList);
+uint64_t hedgeDelay();
+void hedgedGet(const char *file);
+void happyEyeballs(struct addrinfo *serverAddr, const char *action, const char *file);
+int raceRequests(const struct addrinfo *candidates[], int count, uint64_t delay, const char *action, const char *file, int sockets[], char *requestPackets[], uint64_t sentAt[], int *requests);
+void runRaceWinner(int sockfd, const struct addrinfo *address, const char *action, const char *file);
+void cancelRaceLosers(const int sockets[], int requests, int winner);
+void cancelMirror(int sockfd);
+
+// Pool Functions
+void buildServerPool(const char *host);
+void addPoolServers(struct addrinfo *list);
+struct ServerHealth* selectServer();
+void runPoolTransfer(const char *action, const char *file);
+int tryPoolTransfer(struct ServerHealth *server, const char *action, const char *file);
+void freeServerPool();
+
+// Session Cache Functions
+struct addrinfo* lookupResolverCache(const char *host, const char *port);
+void storeResolverCache(const char *host, const char *port, struct addrinfo *list);
+void releaseAddressInfo(struct addrinfo *list);
+int takePooledSocket(int family);
+void refillSocketPool();
+void freeSessionCache();
+
+// Digest Functions
+void prepareDigestCheck(const char *verify);
+void initDigest(struct Digest *digest, int algorithm);
+void updateDigest(struct Digest *digest, const void *data, size_t length);
+void finishDigest(struct Digest *digest, char hex[65]);
+void checkDigest(const char *location, struct Digest *digest);
+void detectDigestInstructions();
+uint32_t crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length);
+uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length);
+void sha256Software(uint32_t state[8], const uint8_t *data, size_t blocks);
+void sha256Hardware(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+// Sparse Functions
+int isZeroBlock(const void *data, size_t length);
+int isRegularFile(FILE *file);
+void initSparseReader(struct SparseReader *reader, FILE *file);
+size_t readSparseBlock(struct SparseReader *reader, FILE *file, char *buffer, size_t length);
+
+// Netascii Functions
+int isNetascii();
+size_t findLineBreak(const uint8_t *data, size_t length, int withLF);
+size_t readNetasciiBlock(struct NetasciiEncoder *encoder, FILE *file, char *buffer, size_t length);
+size_t decodeNetascii(struct NetasciiDecoder *decoder, const char *input, size_t length, char *output);
+
+// Server Functions
+void runServer(const char *host, const char *root, const char *upstream);
+void runServerWorker(int listenfd);
+int openListenSocket(const char *host, const char *port);
+void handleServerRequest(int listenfd);
+int parseRequest(const char *packet, size_t length, char *filename, size_t filenameSize, struct RequestOptions *options);
+int isSafeName(const char *filename);
+int sameAddress(const struct sockaddr *first, const struct sockaddr *second);
+void startSession(int listenfd, const struct ServerRequest *request);
+int translateSessionFile(struct ServerSession *session);
+void handleSessionPacket(struct ServerSession *session);
+void receiveSessionData(struct ServerSession *session, const char *packet, size_t length);
+void handleSessionTimeout(struct ServerSession *session, uint64_t now);
+int fillSessionWindow(struct ServerSession *session);
+ssize_t sendDataBlock(int sockfd, uint16_t blockNumber, const char *data, size_t length, const struct sockaddr *peerAddr);
+uint16_t acknowledgedBlock(const struct ServerSession *session);
+void sendSessionACK(struct ServerSession *session, uint16_t blockNumber);
+void closeSession(struct ServerSession *session, int completed);
+struct HotFile* openHotFile(const char *path);
+void releaseHotFile(struct HotFile *hotFile);
+void freeHotFiles();
+void handleStopSignal(int signum);
+
+// Relay Functions
+pid_t startRelayFetch(int listenfd, const char *filename);
+void collectRelayFetches(int listenfd);
+void finishRelayFetch(int listenfd, struct RelayFetch *fetch, int fetched);
+int isRelayCached(const char *filename);
+int claimSharedFetch(const char *filename);
+int sharedFetchRunning(const char *filename);
+void releaseSharedFetch(const char *filename);
+void makeParentDirectories(char *path);
+
+// Content Cache Functions
+int useContentCache(const char *file);
+int checkContentCache(const struct addrinfo *serverAddr, const char *file);
+void receiveDownload(int sockfd, const struct addrinfo *serverAddr, const char *file);
+int conditionalGet(const struct addrinfo *serverAddr, const char *file);
+void loadCacheEntry(const struct sockaddr *serverAddr, const char *file);
+long long probeTransferSize(const struct addrinfo *serverAddr, const char *file);
+const char* cloneFile(const char *source, const char *destination);
+int sameFile(const char *first, const char *second);
+void storeCacheEntry(const char *output);
+
+// Load Functions
+void runLoad(const struct addrinfo *serverAddr, const char *action, const char *file);
+void runSyntheticClient(const struct addrinfo *serverAddr, const char *action, const char *file, int clientIndex, uint64_t loadStart, struct LoadStats *stats);
+int runSyntheticTransfer(const struct addrinfo *serverAddr, const char *action, const char *file, struct LoadStats *stats);
+
+// Phase Timing Functions
+void beginPhases();
+void markPhase(enum Phase phase);
+uint64_t phaseDuration(const struct PhaseTimings *timings, enum Phase phase);
+void addPhaseSummary(const struct PhaseTimings *timings);
+
+// Core Functions
+void parseCmdArgs(int argc, char *argv[], char **host, char **file, char **action);
+double parseRate(const char *text);
+struct addrinfo* getAddressInfo(const char *host, const char *port);
+int createSocket(const struct addrinfo *serverAddr);
+int openSocket(int family, int socktype, int protocol, struct SocketStats *settings);
+int sizeSocketBuffer(int sockfd, int option, int wanted);
+char* buildRequestPacket(uint16_t opcode, const char *filename, size_t *packetSize);
+char* sendRRQ(int sockfd, const struct sockaddr *serverAddr, const char *filename);
+void rememberRequest(const char *packet, size_t length);
+void resendRequest(int sockfd, const struct sockaddr *serverAddr);
+void receiveFile(int sockfd, const struct sockaddr *serverAddr, const char *filename);
+void abortReceive(FILE *file, struct ReorderBuffer *reorderBuffer, pid_t decompressor);
+void sendACK(int sockfd, const struct sockaddr *serverAddr, uint16_t blockNumber);
+void sendErrorPacket(int sockfd, const struct sockaddr *peerAddr, uint16_t errorCode, const char *message);
+char* sendWRQ(int sockfd, const struct sockaddr *serverAddr, const char *filename);
+int receiveACK(int sockfd, struct sockaddr_storage *peerAddr, struct TransferOptions *transferOptions, char *failure, size_t failureSize);
+void sendFile(int sockfd, const struct sockaddr *serverAddr, const char *file);
+
+// Debug Functions
+void displayDebugHostFileInfo(const char *host, const char *file);
+void displayDebugAddressInfo(const struct addrinfo *serverAddr);
+void displayDebugSocketCreation(int sockfd);
+void displayDebugRRQSuccess();
+void displayDebugReceivedDAT(const char *dataPacket, ssize_t bytesRead);
+void debugDisplayACKSuccess();
+void displayDebugWRQSuccess();
+void displayDebugSentDAT(const char *dataPacket, ssize_t bytesSent);
+void displayDebugReceivedACK(const struct ACKPacket *ackPacket);
+void displayDebugOACK(const struct TransferOptions *transferOptions);
+void displayLatencyHistogram(const struct LatencyHistogram *histogram);
+void displayWakeupHistogram(const struct LatencyHistogram *histogram);
+void displayPhaseTimings(const struct PhaseTimings *timings);
+void displayPhaseSummary(const struct PhaseSummary *summary);
+void displayDebugCaptureFlush(uint64_t captured, uint64_t overwritten);
+void displayLoadStats(const struct LoadStats *stats, uint64_t elapsed);
+void displayWindowStats(const struct WindowController *window, const struct RTTEstimator *estimator);
+void displayReorderStats(const struct ReorderBuffer *buffer);
+void displayPacerStats(const struct Pacer *pacer);
+void displaySocketStats();
+void displayDebugHedge(int winner, int requests, uint64_t delay, uint64_t firstResponse);
+void displayHedgeSummary();
+void displayServerPool();
+void displaySessionCache();
+void displayDigest(const struct Digest *digest, const char *hex, int verified);
+void displaySparseStats(const char *label, uint64_t blocks, uint64_t bytes);
+void displayDebugServer(const char *host, int workers);
+void displayDebugRequest(const struct sockaddr *peerAddr, uint16_t opcode, const char *filename, const char *outcome);
+void displayServerStats();
+void displayDebugContentCache(const char *outcome, const char *method);
+void displayContentCache();
+void displayReplayComparison(int index, const struct ReplayTransfer *transfer, const struct PhaseTimings *timings, const struct LatencyHistogram *latency);
+
+
+
+// -------------------- Helper Functions -------------------- //
+// Function to handle user input
+void processUserInput(int sockfd, struct addrinfo *serverAddr, const char *action, const char *file) {
+    if (strcmp(action, "get") == 0) {
+        // Content cache: skip the transfer when the cached copy still has the size of the remote file
+        if (checkContentCache(serverAddr, file)) {
+            cleanup(serverAddr, sockfd, NULL, NULL);
+            markPhase(PHASE_CLOSE);
+            return;
+        }
+
+        // Send a RRQ (Read Request) to the server
+        char *rrqPacket = sendRRQ(sockfd, serverAddr->ai_addr, file);
+        markPhase(PHASE_REQUEST);
+
+        // Receive the file (multiple DATA packets) from the server
+        receiveDownload(sockfd, serverAddr, file);
+        displaySocketStats();
+
+        // Cleanup before exiting the program
+        cleanup(serverAddr, sockfd, rrqPacket, NULL);
+        markPhase(PHASE_CLOSE);
+    } else if (strcmp(action, "put") == 0) {
+        // Send a WRQ (Write Request) to the server
+        char *wrqPacket = sendWRQ(sockfd, serverAddr->ai_addr, file);
+        markPhase(PHASE_REQUEST);
+
+        // Send a file (multiple DATA Request) to the server
+        sendFile(sockfd, serverAddr->ai_addr, inputPath(file));
+        displaySocketStats();
+
+        // Cleanup before exiting the program
+        cleanup(serverAddr, sockfd, NULL, wrqPacket);
+        markPhase(PHASE_CLOSE);
+    } else if (strcmp(action, "replay") == 0) {
+        // Replay the transfers recorded in the trace file (one socket per transfer)
+        replayTrace(serverAddr, file);
+
+        // Cleanup before exiting the program
+        cleanup(serverAddr, sockfd, NULL, NULL);
+        markPhase(PHASE_CLOSE);
+    } else {
+        // Invalid action
+        handle_error("processUserInput", "Invalid action (use 'get', 'put', 'replay', 'relay' or 'serve')", NULL);
+    }
+}
+
+// Function to handle errors
+void handle_error(const char *location, const char *message, const char *perror_message) {
+    // Print an error message with location and custom message
+    fprintf(stderr, "Error at %s: %s\n", location, message);
+
+    // Check if a custom perror message is provided
+    if (perror_message != NULL) {
+        // Print the perror message for the specific error code
+        perror(perror_message);
+    }
+
+    // A synthetic client (load mode) counts the failure and moves on to its next transfer
+    if (errorJump != NULL) {
+        longjmp(*errorJump, 1);
+    }
+
+    // Exit the program with a failure status
+    exit(EXIT_FAILURE);
+}
+
+// Function to perform cleanup before exiting the program
+void cleanup(struct addrinfo *serverAddr, int sockfd, char *rrqPacket, char *wrqPacket) {
+    // Release the linked list of address info (kept when it is cached)
+    if (serverAddr != NULL) {
+        releaseAddressInfo(serverAddr);
+    }
+
+    // Close the socket
+    if (sockfd != -1) {
+        forgetCaptureSocket(sockfd);
+        close(sockfd);
+    }
+
+    // Free the allocated memory for the RRQ packet
+    if (rrqPacket != NULL) {
+        free(rrqPacket);
+    }
+
+    // Free the allocated memory for the WRQ packet
+    if (wrqPacket != NULL) {
+        free(wrqPacket);
+    }
+}
+
+// Function to get the local destination of a downloaded file (-o, or the remote name)
+const char* outputPath(const char *file) {
+    return clientOptions.output != NULL ? clientOptions.output : file;
+}
+
+// Function to keep stdout for the received data and print the messages on stderr instead (including those still buffered)
+void redirectMessages() {
+    streamFd = dup(STDOUT_FILENO);
+    if (streamFd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+        handle_error("redirectMessages", "Failed to move the messages to stderr", "dup");
+    }
+}
+
+// Function to open the output of a download: a path, stdout (-) or an open descriptor (&fd)
+FILE* openOutput(const char *filename) {
+    FILE *file;
+    if (isStream(filename)) {
+        // Streams are written through a duplicate so that each transfer can close its own
+        int fd = filename[0] == '-' ? (streamFd != -1 ? streamFd : STDOUT_FILENO) : atoi(filename + 1);
+        int duplicate = dup(fd);
+        file = duplicate != -1 ? fdopen(duplicate, "wb") : NULL;
+    } else {
+        file = fopen(filename, "wb");
+    }
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // Coalesce the blocks into large writes (a pipe consumer wakes up once per buffer instead of once per block)
+    setvbuf(file, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    return file;
+}
+
+// Function to get the local source of an uploaded file (-i, or the remote name)
+const char* inputPath(const char *file) {
+    return clientOptions.input != NULL ? clientOptions.input : file;
+}
+
+// Function to check whether a local file name designates stdin/stdout (-) or a descriptor (&fd)
+int isStream(const char *filename) {
+    return strcmp(filename, "-") == 0 || filename[0] == '&';
+}
+
+// Function to open the source of an upload: a path, stdin (-) or an open descriptor (&fd)
+FILE* openInput(const char *filename) {
+    FILE *file;
+    if (isStream(filename)) {
+        int duplicate = dup(filename[0] == '-' ? STDIN_FILENO : atoi(filename + 1));
+        file = duplicate != -1 ? fdopen(duplicate, "rb") : NULL;
+    } else {
+        file = fopen(filename, "rb");
+    }
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // Read ahead in large chunks (a pipe producer is drained once per buffer instead of once per block)
+    setvbuf(file, NULL, _IOFBF, INPUT_BUFFER_SIZE);
+    return file;
+}
+
+// Function to pipe a download to a decompressor when its first block starts with a known magic (returns the new output)
+FILE* startDecompressor(FILE *output, const char *block, size_t length, pid_t *decompressor) {
+    static const struct {
+        const char *magic;
+        size_t magicLength;
+        const char *command;
+    } formats[] = {
+        { "\x1f\x8b", 2, "gzip" },
+        { "\x28\xb5\x2f\xfd", 4, "zstd" },
+        { "\xfd" "7zXZ\0", 6, "xz" },
+    };
+
+    // Find the format of the data (the output is left untouched for anything else)
+    const char *command = NULL;
+    for (size_t i = 0; i < sizeof formats / sizeof formats[0]; i++) {
+        if (length >= formats[i].magicLength && memcmp(block, formats[i].magic, formats[i].magicLength) == 0) {
+            command = formats[i].command;
+        }
+    }
+    if (command == NULL) {
+        return output;
+    }
+
+    // Start the decompressor with the pipe as input and the output file as output
+    int pipeFds[2];
+    if (pipe(pipeFds) == -1) {
+        handle_error("startDecompressor", "Failed to create the decompression pipe", "pipe");
+    }
+    fflush(stdout);
+    *decompressor = fork();
+    if (*decompressor == -1) {
+        handle_error("startDecompressor", "Failed to start the decompressor", "fork");
+    }
+    if (*decompressor == 0) {
+        dup2(pipeFds[0], STDIN_FILENO);
+        dup2(fileno(output), STDOUT_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        execlp(command, command, "-dc", (char *) NULL);
+        fprintf(stderr, "Error at startDecompressor: Failed to run %s\n", command);
+        _exit(127);
+    }
+
+    // The transfer now writes into the pipe, through the same large buffer
+    close(pipeFds[0]);
+    fclose(output);
+    FILE *pipeFile = fdopen(pipeFds[1], "wb");
+    if (pipeFile == NULL) {
+        handle_error("startDecompressor", "Failed to open the decompression pipe", "fdopen");
+    }
+    setvbuf(pipeFile, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (!clientOptions.quiet) {
+        printf("----- startDecompressor -----\n");
+        printf("Format: %s\n", command);
+        printf("\n");
+    }
+    return pipeFile;
+}
+
+// Function to wait for the decompressor once the compressed data has been written
+void finishDecompressor(pid_t decompressor) {
+    int status;
+    if (waitpid(decompressor, &status, 0) == -1) {
+        handle_error("finishDecompressor", "Failed to wait for the decompressor", "waitpid");
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        handle_error("finishDecompressor", "The decompressor failed (corrupted data or command not installed)", NULL);
+    }
+}
+
+// Function to read the monotonic clock in nanoseconds
+uint64_t monotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+// Function to get the length of an IPv4 or IPv6 socket address
+socklen_t addressLength(const struct sockaddr *address) {
+    return address->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+// Function to format the IP address of an IPv4 or IPv6 socket address
+const char* addressToString(const struct sockaddr *address, char *buffer, size_t size) {
+    const void *ip = address->sa_family == AF_INET6 ? (const void *) &((const struct sockaddr_in6 *) address)->sin6_addr
+                                                    : (const void *) &((const struct sockaddr_in *) address)->sin_addr;
+    if (inet_ntop(address->sa_family, ip, buffer, size) == NULL) {
+        snprintf(buffer, size, "?");
+    }
+    return buffer;
+}
+
+// Function to send a packet to the server and capture it
+ssize_t sendPacket(int sockfd, const void *packet, size_t length, const struct sockaddr *peerAddr) {
+    return sendPacketAt(sockfd, packet, length, peerAddr, 0);
+}
+
+// Function to send a packet that the kernel must not release before a departure time (0 to send it now)
+ssize_t sendPacketAt(int sockfd, const void *packet, size_t length, const struct sockaddr *peerAddr, uint64_t departure) {
+    // Replay: pretend to send the packets that were lost in the original trace
+    if (lossSchedule.count != 0 && shouldDropPacket(packet, length)) {
+        return (ssize_t) length;
+    }
+
+    ssize_t bytesSent;
+#ifdef SO_TXTIME
+    if (departure != 0) {
+        // Attach the departure time (CLOCK_MONOTONIC) as an SCM_TXTIME control message
+        struct iovec iov = { (void *) packet, length };
+        char control[CMSG_SPACE(sizeof(uint64_t))];
+        memset(control, 0, sizeof control);
+        struct msghdr message;
+        memset(&message, 0, sizeof message);
+        message.msg_name = (void *) peerAddr;
+        message.msg_namelen = addressLength(peerAddr);
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof control;
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_TXTIME;
+        header->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        memcpy(CMSG_DATA(header), &departure, sizeof(uint64_t));
+
+        bytesSent = sendmsg(sockfd, &message, SENDTO_FLAGS);
+    } else
+#endif
+    {
+        bytesSent = sendto(sockfd, packet, length, SENDTO_FLAGS, peerAddr, addressLength(peerAddr));
+    }
+    if (bytesSent != -1) {
+        capturePacket(sockfd, 1, packet, length, peerAddr);
+    }
+
+    return bytesSent;
+}
+
+// Function to receive a packet and the address of its sender, retrying when interrupted by a signal
+ssize_t receivePacket(int sockfd, void *buffer, size_t length, struct sockaddr_storage *peerAddr) {
+    while (1) {
+        // recvmsg also returns the receive queue drop counter and the kernel timestamps as control messages
+        struct iovec iov = { buffer, length };
+        char control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct msghdr message;
+        memset(&message, 0, sizeof message);
+        message.msg_name = peerAddr;
+        message.msg_namelen = sizeof(struct sockaddr_storage);
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof control;
+
+        ssize_t bytesRead = clientOptions.busyPoll ? spinReceive(sockfd, &message) : recvmsg(sockfd, &message, RECVFROM_FLAGS);
+
+        // A signal (e.g. SIGUSR1) interrupted the wait: serve it and wait again
+        if (bytesRead == -1 && errno == EINTR) {
+            checkStatsRequest();
+            continue;
+        }
+
+        if (bytesRead != -1) {
+            readControlMessages(&message);
+            capturePacket(sockfd, 0, buffer, bytesRead, (struct sockaddr *) peerAddr);
+        }
+
+        return bytesRead;
+    }
+}
+
+// Function to poll the socket without sleeping for BUSY_POLL_US, then block as usual
+ssize_t spinReceive(int sockfd, struct msghdr *message) {
+    socklen_t nameLength = message->msg_namelen;
+    size_t controlLength = message->msg_controllen;
+    uint64_t deadline = monotonicNanoseconds() + (uint64_t) BUSY_POLL_US * 1000ULL;
+
+    while (monotonicNanoseconds() < deadline) {
+        ssize_t bytesRead = recvmsg(sockfd, message, RECVFROM_FLAGS | MSG_DONTWAIT);
+        if (bytesRead != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return bytesRead;
+        }
+        message->msg_namelen = nameLength;
+        message->msg_controllen = controlLength;
+    }
+
+    return recvmsg(sockfd, message, RECVFROM_FLAGS);
+}
+
+// Function to read the receive queue drop counter and the arrival time attached to a received packet
+void readControlMessages(struct msghdr *message) {
+    // Without a kernel timestamp, the packet arrived when recvmsg returned
+    uint64_t now = monotonicNanoseconds();
+    socketStats.lastReceivedAt = now;
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(message); header != NULL; header = CMSG_NXTHDR(message, header)) {
+#ifdef SO_RXQ_OVFL
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&socketStats.drops, CMSG_DATA(header), sizeof(uint32_t));
+        }
+#endif
+#ifdef SO_TIMESTAMPING
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING) {
+            // Software timestamp in ts[0] (CLOCK_REALTIME), raw hardware timestamp in ts[2] (the clock of the NIC, which
+            // is not system time: it is only recorded, the arrival time comes from the software timestamp)
+            struct timespec stamps[3];
+            memcpy(stamps, CMSG_DATA(header), sizeof stamps);
+            if (stamps[2].tv_sec != 0 || stamps[2].tv_nsec != 0) {
+                socketStats.lastHardwareStamp = (uint64_t) stamps[2].tv_sec * 1000000000ULL + (uint64_t) stamps[2].tv_nsec;
+                socketStats.timestamping = 2;
+            }
+            struct timespec *stamp = &stamps[0];
+            if (stamp->tv_sec == 0 && stamp->tv_nsec == 0) {
+                continue;
+            }
+
+            // Move the arrival back on the monotonic clock by the time spent before recvmsg returned
+            struct timespec realtime;
+            clock_gettime(CLOCK_REALTIME, &realtime);
+            int64_t wakeup = ((int64_t) realtime.tv_sec - stamp->tv_sec) * 1000000000LL + (realtime.tv_nsec - stamp->tv_nsec);
+            if (wakeup >= 0 && (uint64_t) wakeup < now) {
+                socketStats.lastReceivedAt = now - (uint64_t) wakeup;
+                recordLatency(&wakeupLatency, (uint64_t) wakeup);
+            }
+        }
+#endif
+    }
+}
+
+// Function to check whether a receive failed because TIMEOUT_MS elapsed
+int isTimeout(ssize_t result) {
+    return result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Function to check whether a packet is scheduled to be lost (first transmission of the block only)
+int shouldDropPacket(const void *packet, size_t length) {
+    if (length < HEADER_SIZE || ntohs(*(const uint16_t *) packet) != lossSchedule.opcode) {
+        return 0;
+    }
+
+    uint16_t blockNumber = ntohs(*(const uint16_t *) ((const char *) packet + sizeof(uint16_t)));
+    for (int index = 0; index < lossSchedule.count; index++) {
+        if (lossSchedule.blocks[index] == blockNumber && !lossSchedule.dropped[index]) {
+            lossSchedule.dropped[index] = 1;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Function to initialize the transfer options to the values used before any OACK
+void initTransferOptions(struct TransferOptions *transferOptions) {
+    // Block size stays at the RFC 1350 default until the server acknowledges BLOCK_OPTION
+    transferOptions->blockSize = DEFAULT_BLOCK_SIZE;
+
+    // Servers commonly wrap to 0; a requested rollover value is assumed until the OACK says otherwise
+    transferOptions->rollover = clientOptions.rollover != NULL ? (uint16_t) atoi(clientOptions.rollover) : 0;
+
+    // Lock-step transfer (one block per ACK) unless the server acknowledges WINDOW_OPTION
+    transferOptions->windowSize = 1;
+
+    // Size unknown unless the server acknowledges TSIZE_OPTION
+    transferOptions->transferSize = -1;
+}
+
+// Function to get the block number following a block, wrapping after 65535
+uint16_t nextBlockNumber(uint16_t blockNumber, const struct TransferOptions *transferOptions) {
+    return blockNumber == UINT16_MAX ? transferOptions->rollover : (uint16_t) (blockNumber + 1);
+}
+
+// Function to parse an OACK (Option Acknowledgment) packet
+int parseOACK(const char *packet, ssize_t length, struct TransferOptions *transferOptions) {
+    // Format of an OACK packet: opcode (2 bytes) + { option (variable) + \0 (1 byte) + value (variable) + \0 (1 byte) }*
+    const char *current = packet + sizeof(uint16_t);
+    const char *end = packet + length;
+
+    while (current < end) {
+        // Locate the option name and its value
+        const char *name = current;
+        const char *nameEnd = memchr(name, '\0', end - name);
+        if (nameEnd == NULL) {
+            break;
+        }
+        const char *value = nameEnd + 1;
+        const char *valueEnd = memchr(value, '\0', end - value);
+        if (valueEnd == NULL) {
+            break;
+        }
+
+        // Apply the options acknowledged by the server
+        if (strcasecmp(name, BLOCK_OPTION) == 0) {
+            transferOptions->blockSize = atoi(value);
+        } else if (strcasecmp(name, ROLLOVER_OPTION) == 0) {
+            transferOptions->rollover = (uint16_t) atoi(value);
+        } else if (strcasecmp(name, WINDOW_OPTION) == 0) {
+            transferOptions->windowSize = atoi(value);
+        } else if (strcasecmp(name, TSIZE_OPTION) == 0) {
+            transferOptions->transferSize = atoll(value);
+        }
+
+        current = valueEnd + 1;
+    }
+
+    // Reject a block size the receive buffers cannot hold, or a windowsize larger than the one requested
+    // (the caller reports it once its transfer resources are released)
+    if (transferOptions->blockSize < MIN_BLOCK_SIZE || transferOptions->blockSize > MAX_BLOCK_SIZE ||
+        transferOptions->windowSize < 1 || transferOptions->windowSize > MAX_WINDOW_SIZE) {
+        return 0;
+    }
+
+    // Display the negotiated options
+    displayDebugOACK(transferOptions);
+    return 1;
+}
+
+// Function to report an ERROR packet received from the server
+void handleErrorPacket(const char *location, const char *packet, ssize_t length) {
+    char message[512];
+    formatErrorPacket(packet, length, message, sizeof message);
+    handle_error(location, message, NULL);
+}
+
+// Function to describe an ERROR packet received from the server
+void formatErrorPacket(const char *packet, ssize_t length, char *message, size_t size) {
+    // Format of an ERROR packet: opcode (2 bytes) + error code (2 bytes) + message (variable) + \0 (1 byte)
+    uint16_t errorCode = 0;
+    if (length >= HEADER_SIZE) {
+        memcpy(&errorCode, packet + sizeof(uint16_t), sizeof(uint16_t));
+    }
+
+    snprintf(message, size, "Server error %hu: %.*s", ntohs(errorCode),
+             length > HEADER_SIZE ? (int) (length - HEADER_SIZE) : 0, packet + HEADER_SIZE);
+}
+
+
+
+// -------------------- Latency Functions -------------------- //
+// Function to map a latency to its log-linear bucket (32 linear sub-buckets per power of two)
+static size_t histogramIndex(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT) {
+        return (size_t) value;
+    }
+
+    unsigned magnitude = 63 - __builtin_clzll(value);
+    unsigned shift = magnitude - HISTOGRAM_SUB_BITS;
+    return (size_t) (shift + 1) * HISTOGRAM_SUB_COUNT + (size_t) ((value >> shift) - HISTOGRAM_SUB_COUNT);
+}
+
+// Function to get the highest value that maps to the same bucket
+static uint64_t histogramBucketLimit(size_t index) {
+    if (index < HISTOGRAM_SUB_COUNT) {
+        return (uint64_t) index;
+    }
+
+    unsigned shift = (unsigned) (index / HISTOGRAM_SUB_COUNT) - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_COUNT;
+    return ((sub + HISTOGRAM_SUB_COUNT + 1) << shift) - 1;
+}
+
+// Function to record a latency sample (lock-free and allocation-free)
+void recordLatency(struct LatencyHistogram *histogram, uint64_t nanoseconds) {
+    atomic_fetch_add_explicit(&histogram->counts[histogramIndex(nanoseconds)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->totalCount, 1, memory_order_relaxed);
+
+    // Raise the maximum if this sample is the largest seen so far
+    uint64_t currentMax = atomic_load_explicit(&histogram->maxValue, memory_order_relaxed);
+    while (nanoseconds > currentMax &&
+           !atomic_compare_exchange_weak_explicit(&histogram->maxValue, &currentMax, nanoseconds,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Function to compute a percentile (0-100) from the histogram buckets
+uint64_t latencyPercentile(const struct LatencyHistogram *histogram, double percentile) {
+    uint64_t totalCount = atomic_load_explicit(&histogram->totalCount, memory_order_relaxed);
+    if (totalCount == 0) {
+        return 0;
+    }
+
+    // Rank of the sample that reaches the requested percentile
+    uint64_t targetCount = (uint64_t) (percentile / 100.0 * (double) totalCount + 0.999999);
+    if (targetCount == 0) {
+        targetCount = 1;
+    }
+
+    uint64_t cumulativeCount = 0;
+    for (size_t index = 0; index < HISTOGRAM_BUCKETS; index++) {
+        cumulativeCount += atomic_load_explicit(&histogram->counts[index], memory_order_relaxed);
+        if (cumulativeCount >= targetCount) {
+            uint64_t limit = histogramBucketLimit(index);
+            uint64_t maxValue = atomic_load_explicit(&histogram->maxValue, memory_order_relaxed);
+            return limit < maxValue ? limit : maxValue;
+        }
+    }
+
+    return atomic_load_explicit(&histogram->maxValue, memory_order_relaxed);
+}
+
+// Function to flag a statistics dump request (async-signal-safe)
+void handleStatsSignal(int signum) {
+    (void) signum;
+    statsRequested = 1;
+}
+
+// Function to dump the histogram on SIGUSR1
+void installStatsSignalHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = handleStatsSignal;
+    sigemptyset(&action.sa_mask);
+
+    // No SA_RESTART so that a blocked recvfrom returns and the dump happens immediately
+    if (sigaction(SIGUSR1, &action, NULL) == -1) {
+        handle_error("installStatsSignalHandler", "Failed to install the SIGUSR1 handler", "sigaction");
+    }
+}
+
+// Function to display the histograms if SIGUSR1 was received
+void checkStatsRequest() {
+    if (statsRequested) {
+        statsRequested = 0;
+        displayLatencyHistogram(&blockLatency);
+        displayWakeupHistogram(&wakeupLatency);
+    }
+}
+
+
+
+// -------------------- Capture Functions -------------------- //
+// Function to preallocate the capture ring and flush it when the program exits (normally or on error)
+void initCaptureRing() {
+    captureRing.capacity = CAPTURE_RING_SIZE / sizeof(struct CaptureRecord);
+    captureRing.records = (struct CaptureRecord *) malloc(captureRing.capacity * sizeof(struct CaptureRecord));
+    if (captureRing.records == NULL) {
+        handle_error("initCaptureRing", "Failed to allocate memory for the capture ring", "malloc");
+    }
+
+    // Touch every page now so that capturing never faults in the transfer loops
+    memset(captureRing.records, 0, captureRing.capacity * sizeof(struct CaptureRecord));
+    captureRing.sockets = (struct CaptureSocket *) calloc(CAPTURE_MAX_SOCKETS, sizeof(struct CaptureSocket));
+    if (captureRing.sockets == NULL) {
+        handle_error("initCaptureRing", "Failed to allocate memory for the capture ring", "calloc");
+    }
+
+    // Offset converting monotonic capture times to the wall-clock times pcap expects
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    captureRing.clockOffset = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec - monotonicNanoseconds();
+
+    if (atexit(flushCaptureRing) != 0) {
+        handle_error("initCaptureRing", "Failed to register the capture flush", NULL);
+    }
+}
+
+// Function to record a datagram in the capture ring (overwrites the oldest record when full)
+void capturePacket(int sockfd, int outgoing, const void *packet, size_t length, const struct sockaddr *peerAddr) {
+    if (captureRing.records == NULL) {
+        return;
+    }
+
+    // Local endpoint of the socket, read at its first datagram: several sockets may be live at once (mirrors, raced
+    // requests, server sessions), and the entry of a descriptor is forgotten when it is closed or reused
+    struct CaptureSocket uncached;
+    struct CaptureSocket *socketInfo = sockfd >= 0 && sockfd < CAPTURE_MAX_SOCKETS ? &captureRing.sockets[sockfd] : &uncached;
+    if (socketInfo == &uncached || !socketInfo->known) {
+        socklen_t localAddrLen = sizeof socketInfo->localAddr;
+        memset(&socketInfo->localAddr, 0, sizeof socketInfo->localAddr);
+        getsockname(sockfd, &socketInfo->localAddr.sa, &localAddrLen);
+        socketInfo->wildcard = socketInfo->localAddr.sa.sa_family == AF_INET6 ? IN6_IS_ADDR_UNSPECIFIED(&socketInfo->localAddr.ipv6.sin6_addr)
+                                                                             : socketInfo->localAddr.ipv4.sin_addr.s_addr == htonl(INADDR_ANY);
+        socketInfo->known = 1;
+    }
+    union CaptureAddress localAddr = socketInfo->localAddr;
+
+    // The socket is bound to the wildcard address: the source address is the one the routing table picks for the peer
+    if (socketInfo->wildcard) {
+        const union CaptureAddress *routeSource = captureRouteSource(peerAddr);
+        if (routeSource->sa.sa_family == AF_INET6 && localAddr.sa.sa_family == AF_INET6) {
+            localAddr.ipv6.sin6_addr = routeSource->ipv6.sin6_addr;
+        } else if (routeSource->sa.sa_family == AF_INET && localAddr.sa.sa_family == AF_INET) {
+            localAddr.ipv4.sin_addr = routeSource->ipv4.sin_addr;
+        }
+    }
+
+    struct CaptureRecord *record = &captureRing.records[captureRing.written % captureRing.capacity];
+    size_t peerAddrLen = addressLength(peerAddr);
+
+    record->timestamp = monotonicNanoseconds();
+    if (outgoing) {
+        record->sourceAddr = localAddr;
+        memcpy(&record->destinationAddr, peerAddr, peerAddrLen);
+    } else {
+        memcpy(&record->sourceAddr, peerAddr, peerAddrLen);
+        record->destinationAddr = localAddr;
+    }
+    record->length = (uint32_t) length;
+    record->capturedLength = (uint32_t) (length < CAPTURE_SNAPLEN ? length : CAPTURE_SNAPLEN);
+    memcpy(record->payload, packet, record->capturedLength);
+
+    captureRing.written++;
+}
+
+// Function to forget the local endpoint of a descriptor that is closed or was just created
+void forgetCaptureSocket(int sockfd) {
+    if (captureRing.sockets != NULL && sockfd >= 0 && sockfd < CAPTURE_MAX_SOCKETS) {
+        captureRing.sockets[sockfd].known = 0;
+    }
+}
+
+// Function to get the source address the routing table picks for a peer (looked up once per recent peer)
+const union CaptureAddress* captureRouteSource(const struct sockaddr *peerAddr) {
+    for (int i = 0; i < CAPTURE_ROUTE_CACHE; i++) {
+        if (sameHost(&captureRing.routes[i].peer.sa, peerAddr)) {
+            return &captureRing.routes[i].source;
+        }
+    }
+
+    // Replace the oldest route by the one of this peer (a connected UDP socket shows the source without sending anything)
+    struct CaptureRoute *route = &captureRing.routes[captureRing.nextRoute];
+    captureRing.nextRoute = (captureRing.nextRoute + 1) % CAPTURE_ROUTE_CACHE;
+    memset(route, 0, sizeof(struct CaptureRoute));
+    memcpy(&route->peer, peerAddr, addressLength(peerAddr));
+    int routeSockfd = socket(peerAddr->sa_family, SOCK_DGRAM, 0);
+    socklen_t routeAddrLen = sizeof route->source;
+    if (routeSockfd != -1) {
+        if (connect(routeSockfd, peerAddr, addressLength(peerAddr)) != 0 || getsockname(routeSockfd, &route->source.sa, &routeAddrLen) != 0) {
+            memset(&route->source, 0, sizeof route->source);
+        }
+        close(routeSockfd);
+    }
+    return &route->source;
+}
+
+// Function to compare the IP addresses (not the ports) of two socket addresses
+int sameHost(const struct sockaddr *first, const struct sockaddr *second) {
+    if (first->sa_family != second->sa_family) {
+        return 0;
+    }
+    if (first->sa_family == AF_INET6) {
+        return memcmp(&((const struct sockaddr_in6 *) first)->sin6_addr, &((const struct sockaddr_in6 *) second)->sin6_addr, sizeof(struct in6_addr)) == 0;
+    }
+    return ((const struct sockaddr_in *) first)->sin_addr.s_addr == ((const struct sockaddr_in *) second)->sin_addr.s_addr;
+}
+
+// Function to compute the one's complement checksum of an IPv4 header
+static uint16_t ipv4Checksum(const unsigned char *header, size_t length) {
+    uint32_t sum = 0;
+    for (size_t index = 0; index < length; index += 2) {
+        sum += (uint32_t) (header[index] << 8 | header[index + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons((uint16_t) ~sum);
+}
+
+// Function to write the capture ring to a pcap file, rebuilding the IP and UDP headers of each datagram
+void flushCaptureRing() {
+    if (captureRing.records == NULL) {
+        return;
+    }
+
+    FILE *pcapFile = fopen(clientOptions.capturePath, "wb");
+    if (pcapFile == NULL) {
+        perror("fopen");
+        return;
+    }
+
+    // Global header: magic, version 2.4, timezone, accuracy, snapshot length, link type
+    uint32_t globalHeader[6] = { PCAP_MAGIC_NANO, 2 | (4 << 16), 0, 0, 40 + 8 + CAPTURE_SNAPLEN, PCAP_LINKTYPE_RAW };
+    fwrite(globalHeader, sizeof globalHeader, 1, pcapFile);
+
+    // Oldest record first (the ring may have wrapped)
+    uint64_t count = captureRing.written < captureRing.capacity ? captureRing.written : captureRing.capacity;
+    uint64_t first = captureRing.written - count;
+
+    for (uint64_t index = first; index < captureRing.written; index++) {
+        const struct CaptureRecord *record = &captureRing.records[index % captureRing.capacity];
+        unsigned char headers[40 + 8];
+        size_t ipHeaderSize;
+        uint16_t sourcePort, destinationPort;
+
+        memset(headers, 0, sizeof headers);
+        if (record->sourceAddr.sa.sa_family == AF_INET6) {
+            // IPv6 header: version, payload length, next header (UDP), hop limit, addresses
+            ipHeaderSize = 40;
+            headers[0] = 0x60;
+            *(uint16_t *) (headers + 4) = htons((uint16_t) (8 + record->length));
+            headers[6] = IPPROTO_UDP;
+            headers[7] = 64;
+            memcpy(headers + 8, &record->sourceAddr.ipv6.sin6_addr, 16);
+            memcpy(headers + 24, &record->destinationAddr.ipv6.sin6_addr, 16);
+            sourcePort = record->sourceAddr.ipv6.sin6_port;
+            destinationPort = record->destinationAddr.ipv6.sin6_port;
+        } else {
+            // IPv4 header: version/IHL, total length, TTL, protocol (UDP), checksum, addresses
+            ipHeaderSize = 20;
+            headers[0] = 0x45;
+            *(uint16_t *) (headers + 2) = htons((uint16_t) (20 + 8 + record->length));
+            headers[8] = 64;
+            headers[9] = IPPROTO_UDP;
+            memcpy(headers + 12, &record->sourceAddr.ipv4.sin_addr, 4);
+            memcpy(headers + 16, &record->destinationAddr.ipv4.sin_addr, 4);
+            *(uint16_t *) (headers + 10) = ipv4Checksum(headers, 20);
+            sourcePort = record->sourceAddr.ipv4.sin_port;
+            destinationPort = record->destinationAddr.ipv4.sin_port;
+        }
+
+        // UDP header: ports, length, checksum left at 0
+        *(uint16_t *) (headers + ipHeaderSize) = sourcePort;
+        *(uint16_t *) (headers + ipHeaderSize + 2) = destinationPort;
+        *(uint16_t *) (headers + ipHeaderSize + 4) = htons((uint16_t) (8 + record->length));
+
+        // Record header: seconds, nanoseconds, captured length, original length
+        uint64_t timestamp = record->timestamp + captureRing.clockOffset;
+        uint32_t recordHeader[4] = {
+            (uint32_t) (timestamp / 1000000000ULL), (uint32_t) (timestamp % 1000000000ULL),
+            (uint32_t) (ipHeaderSize + 8 + record->capturedLength), (uint32_t) (ipHeaderSize + 8 + record->length)
+        };
+        fwrite(recordHeader, sizeof recordHeader, 1, pcapFile);
+        fwrite(headers, 1, ipHeaderSize + 8, pcapFile);
+        fwrite(record->payload, 1, record->capturedLength, pcapFile);
+    }
+
+    fclose(pcapFile);
+    displayDebugCaptureFlush(count, captureRing.written - count);
+}
+
+
+
+// -------------------- Replay Functions -------------------- //
+// Function to load the transfers recorded in a pcap file (from -w or tcpdump)
+int loadTrace(const char *tracePath, struct ReplayTransfer **transfers) {
+    FILE *traceFile = fopen(tracePath, "rb");
+    if (traceFile == NULL) {
+        handle_error("loadTrace", "Failed to open the trace file", "fopen");
+    }
+
+    // Read the global header and detect the timestamp resolution
+    uint32_t globalHeader[6];
+    if (fread(globalHeader, sizeof globalHeader, 1, traceFile) != 1) {
+        fclose(traceFile);
+        handle_error("loadTrace", "Trace file is too short", NULL);
+    }
+    if (globalHeader[0] != PCAP_MAGIC_NANO && globalHeader[0] != PCAP_MAGIC_MICRO) {
+        fclose(traceFile);
+        handle_error("loadTrace", "Trace file is not a pcap file in host byte order", NULL);
+    }
+    uint64_t fractionScale = globalHeader[0] == PCAP_MAGIC_NANO ? 1 : 1000;
+
+    // Offset of the IP header for the supported link types
+    size_t linkHeaderSize;
+    switch (globalHeader[5]) {
+        case PCAP_LINKTYPE_RAW:
+            linkHeaderSize = 0;
+            break;
+        case PCAP_LINKTYPE_NULL:
+            linkHeaderSize = 4;
+            break;
+        case PCAP_LINKTYPE_ETHERNET:
+            linkHeaderSize = 14;
+            break;
+        case PCAP_LINKTYPE_LINUX_SLL:
+            linkHeaderSize = 16;
+            break;
+        default:
+            fclose(traceFile);
+            handle_error("loadTrace", "Unsupported pcap link type", NULL);
+    }
+
+    *transfers = (struct ReplayTransfer *) calloc(REPLAY_MAX_TRANSFERS, sizeof(struct ReplayTransfer));
+    if (*transfers == NULL) {
+        fclose(traceFile);
+        handle_error("loadTrace", "Failed to allocate memory for the trace", "calloc");
+    }
+
+    int count = 0;
+    unsigned char frame[HEADER_SIZE + MAX_BLOCK_SIZE + 128];
+    uint32_t recordHeader[4];
+
+    while (fread(recordHeader, sizeof recordHeader, 1, traceFile) == 1) {
+        // Record header: seconds, fraction, captured length, original length
+        uint64_t timestamp = (uint64_t) recordHeader[0] * 1000000000ULL + (uint64_t) recordHeader[1] * fractionScale;
+        size_t capturedLength = recordHeader[2];
+        if (capturedLength > sizeof frame || fread(frame, 1, capturedLength, traceFile) != capturedLength) {
+            break;
+        }
+        if (capturedLength < linkHeaderSize + 1) {
+            continue;
+        }
+
+        // Locate the UDP header behind the IPv4 or IPv6 header (and the length of the IP payload, from the header)
+        const unsigned char *ipHeader = frame + linkHeaderSize;
+        size_t available = capturedLength - linkHeaderSize;
+        size_t ipHeaderSize;
+        size_t ipPayloadSize;
+        if ((ipHeader[0] >> 4) == 4 && available >= 20 && ipHeader[9] == IPPROTO_UDP) {
+            ipHeaderSize = (size_t) (ipHeader[0] & 0x0f) * 4;
+            size_t totalLength = (size_t) (ipHeader[2] << 8 | ipHeader[3]);
+            if (ipHeaderSize < 20 || totalLength < ipHeaderSize) {
+                continue;
+            }
+            ipPayloadSize = totalLength - ipHeaderSize;
+        } else if ((ipHeader[0] >> 4) == 6 && available >= 40 && ipHeader[6] == IPPROTO_UDP) {
+            ipHeaderSize = 40;
+            ipPayloadSize = (size_t) (ipHeader[4] << 8 | ipHeader[5]);
+        } else {
+            continue;
+        }
+        if (available < ipHeaderSize + 8 + HEADER_SIZE) {
+            continue;
+        }
+
+        // A malformed record (UDP length shorter than its header, or longer than the IP payload or the original frame) is skipped
+        const unsigned char *udpHeader = ipHeader + ipHeaderSize;
+        uint16_t sourcePort = (uint16_t) (udpHeader[0] << 8 | udpHeader[1]);
+        uint16_t destinationPort = (uint16_t) (udpHeader[2] << 8 | udpHeader[3]);
+        size_t udpLength = (size_t) (udpHeader[4] << 8 | udpHeader[5]);
+        size_t originalLength = recordHeader[3];
+        if (udpLength < 8 + HEADER_SIZE || udpLength > ipPayloadSize || linkHeaderSize + ipHeaderSize + udpLength > originalLength) {
+            continue;
+        }
+        size_t length = udpLength - 8;
+
+        size_t payloadCaptured = available - ipHeaderSize - 8;
+        addTracePacket(*transfers, &count, timestamp, sourcePort, destinationPort,
+                       udpHeader + 8, payloadCaptured < length ? payloadCaptured : length, length);
+    }
+
+    fclose(traceFile);
+    return count;
+}
+
+// Function to add a traced datagram to its transfer (the client port identifies the transfer)
+void addTracePacket(struct ReplayTransfer *transfers, int *count, uint64_t timestamp, uint16_t sourcePort, uint16_t destinationPort, const unsigned char *payload, size_t capturedLength, size_t length) {
+    uint16_t opcode = (uint16_t) (payload[0] << 8 | payload[1]);
+    uint16_t blockNumber = (uint16_t) (payload[2] << 8 | payload[3]);
+
+    // A request starts a new transfer
+    if (opcode == OPCODE_RRQ || opcode == OPCODE_WRQ) {
+        if (*count == REPLAY_MAX_TRANSFERS) {
+            return;
+        }
+
+        struct ReplayTransfer *transfer = &transfers[(*count)++];
+        transfer->opcode = opcode;
+        transfer->clientPort = sourcePort;
+        transfer->requestTime = timestamp;
+        transfer->endTime = timestamp;
+        transfer->lastOutgoingBlock = -1;
+        transfer->lastIncomingBlock = -1;
+        transfer->losses.opcode = opcode == OPCODE_RRQ ? OPCODE_ACK : OPCODE_DATA;
+
+        // Request fields: filename, mode, then option name/value pairs
+        const char *current = (const char *) payload + sizeof(uint16_t);
+        const char *end = (const char *) payload + capturedLength;
+        const char *fields[8];
+        int fieldCount = 0;
+        while (current < end && fieldCount < 8) {
+            const char *fieldEnd = memchr(current, '\0', end - current);
+            if (fieldEnd == NULL) {
+                break;
+            }
+            fields[fieldCount++] = current;
+            current = fieldEnd + 1;
+        }
+        if (fieldCount > 0) {
+            snprintf(transfer->filename, sizeof transfer->filename, "%s", fields[0]);
+        }
+        for (int field = 2; field + 1 < fieldCount; field += 2) {
+            if (strcasecmp(fields[field], BLOCK_OPTION) == 0) {
+                snprintf(transfer->blockSize, sizeof transfer->blockSize, "%s", fields[field + 1]);
+            }
+        }
+        return;
+    }
+
+    // Find the most recent transfer of this client port
+    struct ReplayTransfer *transfer = NULL;
+    int outgoing = 0;
+    for (int index = *count - 1; index >= 0; index--) {
+        if (transfers[index].clientPort == sourcePort || transfers[index].clientPort == destinationPort) {
+            transfer = &transfers[index];
+            outgoing = transfers[index].clientPort == sourcePort;
+            break;
+        }
+    }
+    if (transfer == NULL) {
+        return;
+    }
+
+    transfer->endTime = timestamp;
+    if (!outgoing && transfer->firstResponseTime == 0) {
+        transfer->firstResponseTime = timestamp;
+    }
+
+    // A block seen twice in the same direction reveals a loss of the first transmission
+    int *lastBlock = outgoing ? &transfer->lastOutgoingBlock : &transfer->lastIncomingBlock;
+    int duplicate = (opcode == OPCODE_DATA || opcode == OPCODE_ACK) && *lastBlock >= 0 &&
+                    (uint16_t) (*lastBlock - blockNumber) < 0x8000;
+    uint16_t lostBlock = blockNumber;
+
+    if (transfer->opcode == OPCODE_RRQ && opcode == OPCODE_DATA && !outgoing) {
+        // get: a repeated DATA block means our ACK of that block was lost
+        if (!duplicate) {
+            transfer->bytes += length - HEADER_SIZE;
+            if (transfer->pendingSince != 0) {
+                recordLatency(&transfer->latency, timestamp - transfer->pendingSince);
+            }
+        }
+    } else if (transfer->opcode == OPCODE_RRQ && opcode == OPCODE_ACK && outgoing) {
+        transfer->pendingSince = timestamp;
+    } else if (transfer->opcode == OPCODE_WRQ && opcode == OPCODE_DATA && outgoing) {
+        // put: a repeated DATA block means its first transmission was lost
+        if (!duplicate) {
+            transfer->bytes += length - HEADER_SIZE;
+        }
+        transfer->pendingSince = timestamp;
+    } else if (transfer->opcode == OPCODE_WRQ && opcode == OPCODE_ACK && !outgoing) {
+        // put: a repeated ACK means the following DATA block was lost
+        lostBlock = (uint16_t) (blockNumber + 1);
+        if (!duplicate && blockNumber > 0 && transfer->pendingSince != 0) {
+            recordLatency(&transfer->latency, timestamp - transfer->pendingSince);
+        }
+    } else {
+        return;
+    }
+
+    if (!duplicate) {
+        *lastBlock = blockNumber;
+        return;
+    }
+
+    // Schedule the loss once per block
+    struct LossSchedule *losses = &transfer->losses;
+    for (int index = 0; index < losses->count; index++) {
+        if (losses->blocks[index] == lostBlock) {
+            return;
+        }
+    }
+    if (losses->count < REPLAY_MAX_LOSSES) {
+        losses->blocks[losses->count++] = lostBlock;
+    }
+}
+
+// Function to replay the transfers of a trace against the server and compare them with the original
+void replayTrace(const struct addrinfo *serverAddr, const char *tracePath) {
+    struct ReplayTransfer *transfers;
+    int count = loadTrace(tracePath, &transfers);
+    if (count == 0) {
+        free(transfers);
+        handle_error("replayTrace", "No TFTP request found in the trace", NULL);
+    }
+
+    uint64_t replayStart = monotonicNanoseconds();
+
+    for (int index = 0; index < count; index++) {
+        struct ReplayTransfer *transfer = &transfers[index];
+
+        // Keep the original gap between requests
+        uint64_t dueTime = replayStart + (transfer->requestTime - transfers[0].requestTime);
+        uint64_t now = monotonicNanoseconds();
+        if (dueTime > now) {
+            struct timespec delay = { (time_t) ((dueTime - now) / 1000000000ULL), (long) ((dueTime - now) % 1000000000ULL) };
+            nanosleep(&delay, NULL);
+        }
+
+        // Request the same block size and drop the same packets as the original client
+        clientOptions.blockSize = transfer->blockSize[0] != '\0' ? transfer->blockSize : BLOCK_SIZE;
+        lossSchedule = transfer->losses;
+        memset(&blockLatency, 0, sizeof blockLatency);
+
+        int sockfd = createSocket(serverAddr);
+        beginPhases();
+        if (transfer->opcode == OPCODE_RRQ) {
+            // Downloaded data is discarded
+            char *rrqPacket = sendRRQ(sockfd, serverAddr->ai_addr, transfer->filename);
+            markPhase(PHASE_REQUEST);
+            receiveFile(sockfd, serverAddr->ai_addr, "/dev/null");
+            free(rrqPacket);
+        } else {
+            // Uploaded data comes from a sparse temporary file of the original size
+            char tempPath[] = "/tmp/tftp_replay_XXXXXX";
+            int tempFd = mkstemp(tempPath);
+            if (tempFd == -1 || ftruncate(tempFd, (off_t) transfer->bytes) == -1) {
+                handle_error("replayTrace", "Failed to create the upload file", "mkstemp");
+            }
+            close(tempFd);
+
+            char *wrqPacket = sendWRQ(sockfd, serverAddr->ai_addr, transfer->filename);
+            markPhase(PHASE_REQUEST);
+            sendFile(sockfd, serverAddr->ai_addr, tempPath);
+            unlink(tempPath);
+            free(wrqPacket);
+        }
+        close(sockfd);
+        markPhase(PHASE_CLOSE);
+
+        displayReplayComparison(index, transfer, &currentPhases, &blockLatency);
+    }
+
+    lossSchedule.count = 0;
+    free(transfers);
+}
+
+
+
+// -------------------- Window Functions -------------------- //
+// Function to wait until a packet can be read (returns 0 when the timeout expires)
+int waitReadable(int sockfd, uint64_t timeout) {
+    struct pollfd pollDescriptor = { sockfd, POLLIN, 0 };
+    uint64_t deadline = monotonicNanoseconds() + timeout;
+
+    while (1) {
+        uint64_t now = monotonicNanoseconds();
+        int remaining = now >= deadline ? 0 : (int) ((deadline - now + 999999) / 1000000);
+        int ready = poll(&pollDescriptor, 1, remaining);
+
+        // A signal (e.g. SIGUSR1) interrupted the wait: serve it and wait for the remaining time
+        if (ready == -1 && errno == EINTR) {
+            checkStatsRequest();
+            continue;
+        }
+
+        return ready > 0;
+    }
+}
+
+// Function to initialize the retransmission timer before any RTT sample
+void initRTTEstimator(struct RTTEstimator *estimator) {
+    estimator->smoothedRTT = 0;
+    estimator->rttVariation = 0;
+    estimator->timeout = (uint64_t) TIMEOUT_MS * 1000000ULL;
+}
+
+// Function to update the smoothed RTT and the retransmission timeout with a sample (RFC 6298)
+void updateRTTEstimator(struct RTTEstimator *estimator, uint64_t sample) {
+    if (estimator->smoothedRTT == 0) {
+        estimator->smoothedRTT = sample;
+        estimator->rttVariation = sample / 2;
+    } else {
+        uint64_t difference = sample > estimator->smoothedRTT ? sample - estimator->smoothedRTT : estimator->smoothedRTT - sample;
+        estimator->rttVariation = (3 * estimator->rttVariation + difference) / 4;
+        estimator->smoothedRTT = (7 * estimator->smoothedRTT + sample) / 8;
+    }
+
+    estimator->timeout = estimator->smoothedRTT + 4 * estimator->rttVariation;
+    if (estimator->timeout < (uint64_t) MIN_TIMEOUT_MS * 1000000ULL) {
+        estimator->timeout = (uint64_t) MIN_TIMEOUT_MS * 1000000ULL;
+    }
+    if (estimator->timeout > (uint64_t) MAX_TIMEOUT_MS * 1000000ULL) {
+        estimator->timeout = (uint64_t) MAX_TIMEOUT_MS * 1000000ULL;
+    }
+}
+
+// Function to double the retransmission timeout after a timeout
+void backoffRTTEstimator(struct RTTEstimator *estimator) {
+    estimator->timeout *= 2;
+    if (estimator->timeout > (uint64_t) MAX_TIMEOUT_MS * 1000000ULL) {
+        estimator->timeout = (uint64_t) MAX_TIMEOUT_MS * 1000000ULL;
+    }
+}
+
+// Function to initialize the in-flight window below the negotiated windowsize
+void initWindowController(struct WindowController *window, int ceiling) {
+    window->ceiling = ceiling;
+    window->congestionWindow = clientOptions.adaptiveWindow ? 1 : ceiling;
+    window->decreases = 0;
+    window->retransmissions = 0;
+}
+
+// Function to grow the window by one block after a clean window (additive increase)
+void growWindow(struct WindowController *window) {
+    if (clientOptions.adaptiveWindow && window->congestionWindow < window->ceiling) {
+        window->congestionWindow++;
+    }
+}
+
+// Function to halve the window after a timeout or a loss signal (multiplicative decrease)
+void shrinkWindow(struct WindowController *window) {
+    window->decreases++;
+    if (clientOptions.adaptiveWindow && window->congestionWindow > 1) {
+        window->congestionWindow /= 2;
+    }
+}
+
+// Function to get the block number carried by a sequence (wrapping to the rollover block after 65535)
+uint16_t blockFromSequence(uint64_t sequence, const struct TransferOptions *transferOptions) {
+    if (transferOptions->rollover == 1) {
+        return (uint16_t) ((sequence - 1) % UINT16_MAX + 1);
+    }
+    return (uint16_t) sequence;
+}
+
+// Function to find the sequence between two bounds that carries a block number
+int sequenceFromBlock(uint16_t blockNumber, uint64_t first, uint64_t last, const struct TransferOptions *transferOptions, uint64_t *sequence) {
+    for (uint64_t candidate = first; candidate <= last; candidate++) {
+        if ((candidate == 0 ? 0 : blockFromSequence(candidate, transferOptions)) == blockNumber) {
+            *sequence = candidate;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to count the blocks from one block number to another (following the rollover)
+int blockDistance(uint16_t from, uint16_t to, const struct TransferOptions *transferOptions) {
+    if (transferOptions->rollover == 1 && from != 0 && to != 0) {
+        return (int) ((to + UINT16_MAX - from) % UINT16_MAX);
+    }
+    return (uint16_t) (to - from);
+}
+
+// Function to set up pacing on the socket (kernel departure times when SO_TXTIME is supported)
+void initPacer(struct Pacer *pacer, int sockfd) {
+    memset(pacer, 0, sizeof(struct Pacer));
+    pacer->enabled = clientOptions.pacing || clientOptions.bandwidthCap > 0;
+    pacer->rate = clientOptions.bandwidthCap;
+    if (!pacer->enabled) {
+        return;
+    }
+
+#ifdef SO_TXTIME
+    // The fq qdisc releases each packet at its departure time; without SO_TXTIME fall back to sleeping
+    struct sock_txtime txtime = { CLOCK_MONOTONIC, 0 };
+    pacer->kernelPacing = setsockopt(sockfd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof txtime) == 0;
+#else
+    (void) sockfd;
+#endif
+}
+
+// Function to set the pacing rate to the in-flight window per smoothed RTT, within the bandwidth cap
+void updatePacingRate(struct Pacer *pacer, const struct WindowController *window, const struct RTTEstimator *estimator, int packetSize) {
+    if (!clientOptions.pacing || estimator->smoothedRTT == 0) {
+        return;
+    }
+
+    double rate = PACING_GAIN * window->congestionWindow * packetSize * 1e9 / (double) estimator->smoothedRTT;
+    if (clientOptions.bandwidthCap > 0 && rate > clientOptions.bandwidthCap) {
+        rate = clientOptions.bandwidthCap;
+    }
+    pacer->rate = rate;
+}
+
+// Function to get the departure time of the next packet from the token bucket (sleeping without SO_TXTIME)
+uint64_t paceDeparture(struct Pacer *pacer, size_t length) {
+    if (!pacer->enabled || pacer->rate <= 0) {
+        return 0;
+    }
+
+    // Tokens accumulated while idle are capped at PACING_BURST_PACKETS packets
+    uint64_t now = monotonicNanoseconds();
+    uint64_t interval = (uint64_t) (length * 1e9 / pacer->rate);
+    uint64_t burst = PACING_BURST_PACKETS * interval;
+    if (pacer->nextDeparture + burst < now) {
+        pacer->nextDeparture = now - burst;
+    }
+    uint64_t departure = pacer->nextDeparture > now ? pacer->nextDeparture : now;
+    pacer->nextDeparture += interval;
+
+    // Wait for the departure time (user-space token bucket), or until it is within the kernel horizon (SO_TXTIME),
+    // so that the average rate holds even when the qdisc ignores departure times
+    uint64_t wakeup = pacer->kernelPacing ? departure - (uint64_t) PACING_HORIZON_US * 1000ULL : departure;
+    if (wakeup > now && departure > now) {
+        struct timespec delay = { (time_t) ((wakeup - now) / 1000000000ULL), (long) ((wakeup - now) % 1000000000ULL) };
+        nanosleep(&delay, NULL);
+        pacer->sleeps++;
+    }
+    return pacer->kernelPacing ? departure : 0;
+}
+
+// Function to allocate the ring holding the DATA packets of one window
+void initSendRing(struct SendRing *ring, int capacity, int blockSize) {
+    ring->capacity = capacity;
+    ring->packetSize = HEADER_SIZE + blockSize;
+    ring->packets = malloc((size_t) capacity * (size_t) ring->packetSize);
+    if (ring->packets == NULL) {
+        handle_error("initSendRing", "Failed to allocate the send ring", "malloc");
+    }
+}
+
+// Function to get the slot of a block in the send ring (blocks in flight never share a slot)
+char* sendRingSlot(struct SendRing *ring, uint64_t sequence) {
+    return ring->packets + (size_t) (sequence % (uint64_t) ring->capacity) * (size_t) ring->packetSize;
+}
+
+// Function to release the send ring
+void freeSendRing(struct SendRing *ring) {
+    free(ring->packets);
+    ring->packets = NULL;
+}
+
+// Function to prepare an empty reorder buffer of one window
+void initReorderBuffer(struct ReorderBuffer *buffer, int capacity, int blockSize) {
+    memset(buffer, 0, sizeof(struct ReorderBuffer));
+    buffer->capacity = capacity;
+    buffer->blockSize = blockSize;
+    buffer->data = malloc((size_t) capacity * (size_t) blockSize);
+    if (buffer->data == NULL) {
+        handle_error("initReorderBuffer", "Failed to allocate the reorder buffer", "malloc");
+    }
+}
+
+// Function to keep a block that arrived ahead of the expected one (distance blocks ahead)
+void storeReorderBlock(struct ReorderBuffer *buffer, int distance, const char *data, size_t length) {
+    int slot = (buffer->head + distance) % buffer->capacity;
+    if (buffer->present[slot]) {
+        buffer->duplicates++;
+        return;
+    }
+
+    memcpy(buffer->data + (size_t) slot * (size_t) buffer->blockSize, data, length);
+    buffer->lengths[slot] = length;
+    buffer->present[slot] = 1;
+    buffer->buffered++;
+    buffer->reordered++;
+}
+
+// Function to move past the block just written and get the following one if it is already held
+int nextReorderBlock(struct ReorderBuffer *buffer, const char **data, size_t *length) {
+    if (buffer->data == NULL) {
+        return 0;
+    }
+
+    // Free the slot of the block just written (held or received in order)
+    if (buffer->present[buffer->head]) {
+        buffer->present[buffer->head] = 0;
+        buffer->buffered--;
+    }
+    buffer->head = (buffer->head + 1) % buffer->capacity;
+
+    if (!buffer->present[buffer->head]) {
+        return 0;
+    }
+    *data = buffer->data + (size_t) buffer->head * (size_t) buffer->blockSize;
+    *length = buffer->lengths[buffer->head];
+    return 1;
+}
+
+// Function to release the reorder buffer
+void freeReorderBuffer(struct ReorderBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+}
+
+
+
+// -------------------- Mirror Functions -------------------- //
+// Function to split a comma-separated host list into the mirrors to try
+void parseMirrors(char *hostList) {
+    for (char *mirror = strtok(hostList, ","); mirror != NULL; mirror = strtok(NULL, ",")) {
+        if (hedgeStats.mirrorCount == MAX_MIRRORS) {
+            handle_error("parseMirrors", "Too many mirrors (at most 8)", NULL);
+        }
+        hedgeStats.mirrors[hedgeStats.mirrorCount++] = mirror;
+    }
+}
+
+// Function to get the time to wait for a first response before asking the next mirror
+uint64_t hedgeDelay() {
+    if (atomic_load_explicit(&hedgeStats.firstResponse.totalCount, memory_order_relaxed) < HEDGE_MIN_SAMPLES) {
+        return (uint64_t) HEDGE_DEFAULT_MS * 1000000ULL;
+    }
+    return latencyPercentile(&hedgeStats.firstResponse, clientOptions.hedgePercentile);
+}
+
+// Function to download a file from whichever mirror answers first, asking the next one when the current ones are slow
+void hedgedGet(const char *file) {
+    struct addrinfo *mirrorAddr[MAX_MIRRORS];
+    const struct addrinfo *candidates[MAX_MIRRORS];
+    int sockets[MAX_MIRRORS];
+    char *rrqPackets[MAX_MIRRORS];
+    uint64_t sentAt[MAX_MIRRORS];
+    uint64_t delay = hedgeDelay();
+    int requests = 0;
+
+    // Resolve the mirrors (the first address of each)
+    for (int i = 0; i < hedgeStats.mirrorCount; i++) {
+        mirrorAddr[i] = getAddressInfo(hedgeStats.mirrors[i], clientOptions.port);
+        candidates[i] = mirrorAddr[i];
+    }
+    markPhase(PHASE_RESOLVE);
+
+    // Ask the mirrors one hedge delay apart until one answers
+    int winner = raceRequests(candidates, hedgeStats.mirrorCount, delay, "get", file, sockets, rrqPackets, sentAt, &requests);
+
+    // Record how long the winner took to answer its last RRQ
+    uint64_t firstResponse = monotonicNanoseconds() - sentAt[winner];
+    recordLatency(&hedgeStats.firstResponse, firstResponse);
+    hedgeStats.transfers++;
+    hedgeStats.hedges += requests - 1;
+    hedgeStats.wins[winner]++;
+    displayDebugHedge(winner, requests, delay, firstResponse);
+
+    // Receive the file from the winner, then cancel the mirrors that answered meanwhile and release them
+    runRaceWinner(sockets[winner], mirrorAddr[winner], "get", file);
+    cancelRaceLosers(sockets, requests, winner);
+    for (int i = 0; i < hedgeStats.mirrorCount; i++) {
+        free(i < requests ? rrqPackets[i] : NULL);
+        releaseAddressInfo(mirrorAddr[i]);
+    }
+}
+
+// Function to run a transfer on the address (IPv6 or IPv4) that answers the request first
+void happyEyeballs(struct addrinfo *serverAddr, const char *action, const char *file) {
+    const struct addrinfo *candidates[MAX_SERVERS];
+    int sockets[MAX_SERVERS];
+    char *requestPackets[MAX_SERVERS];
+    uint64_t sentAt[MAX_SERVERS];
+    int count = 0;
+    int requests = 0;
+
+    // Interleave the address families, starting with the family preferred by getaddrinfo (RFC 8305, section 4)
+    const struct addrinfo *next[2] = { serverAddr, NULL };
+    for (const struct addrinfo *address = serverAddr; address != NULL; address = address->ai_next) {
+        if (address->ai_family != serverAddr->ai_family) {
+            next[1] = address;
+            break;
+        }
+    }
+    for (int family = 0; count < MAX_SERVERS && (next[0] != NULL || next[1] != NULL); family = !family) {
+        if (next[family] == NULL) {
+            continue;
+        }
+        candidates[count++] = next[family];
+        int wanted = next[family]->ai_family;
+        do {
+            next[family] = next[family]->ai_next;
+        } while (next[family] != NULL && (next[family]->ai_family != wanted));
+    }
+
+    // Start with the first address and move to the next one every Connection Attempt Delay
+    // (only RRQs are raced: a late WRQ reaching the same server would truncate the upload in progress)
+    int winner = raceRequests(candidates, count, (uint64_t) HAPPY_EYEBALLS_DELAY_MS * 1000000ULL, "get", file, sockets, requestPackets, sentAt, &requests);
+    char *wrqPacket = NULL;
+    if (strcmp(action, "put") == 0) {
+        // The RRQ was only a probe: end it and send the one WRQ to the address that answered, from a new socket
+        cancelMirror(sockets[winner]);
+        cleanup(NULL, sockets[winner], NULL, NULL);
+        sockets[winner] = createSocket(candidates[winner]);
+        wrqPacket = sendWRQ(sockets[winner], candidates[winner]->ai_addr, file);
+    }
+    runRaceWinner(sockets[winner], candidates[winner], action, file);
+    cancelRaceLosers(sockets, requests, winner);
+    for (int i = 0; i < requests; i++) {
+        free(requestPackets[i]);
+    }
+    free(wrqPacket);
+    releaseAddressInfo(serverAddr);
+}
+
+// Function to send the request to each candidate in turn, one delay apart, until one of them answers (returns its index)
+// The sockets of the other candidates are left open: cancelRaceLosers ends their requests once the winner is done
+int raceRequests(const struct addrinfo *candidates[], int count, uint64_t delay, const char *action, const char *file, int sockets[], char *requestPackets[], uint64_t sentAt[], int *requests) {
+    struct pollfd pollDescriptors[MAX_SERVERS];
+    uint64_t lastRequestAt = 0;
+    int winner = -1;
+    int retries = 0;
+    *requests = 0;
+
+    while (winner == -1) {
+        // Send the request to the next candidate: the first one right away, the others once the delay has passed
+        uint64_t now = monotonicNanoseconds();
+        if (*requests < count && (*requests == 0 || now - lastRequestAt >= delay)) {
+            int i = (*requests)++;
+            sockets[i] = createSocket(candidates[i]);
+            if (i == 0) {
+                markPhase(PHASE_SOCKET);
+            }
+            requestPackets[i] = strcmp(action, "get") == 0 ? sendRRQ(sockets[i], candidates[i]->ai_addr, file)
+                                                           : sendWRQ(sockets[i], candidates[i]->ai_addr, file);
+            if (i == 0) {
+                markPhase(PHASE_REQUEST);
+            }
+            lastRequestAt = monotonicNanoseconds();
+            sentAt[i] = lastRequestAt;
+            pollDescriptors[i].fd = sockets[i];
+            pollDescriptors[i].events = POLLIN;
+            continue;
+        }
+
+        // Wait for a first response until the next request (once every candidate was asked, until the requests are resent)
+        uint64_t waitUntil = lastRequestAt + (*requests < count ? delay : (uint64_t) TIMEOUT_MS * 1000000ULL);
+        if (now >= waitUntil) {
+            if (*requests == count) {
+                // The requests may have been lost: send them again to every candidate
+                if (++retries > MAX_RETRIES) {
+                    handle_error("raceRequests", "Timed out waiting for a first response", NULL);
+                }
+                for (int i = 0; i < *requests; i++) {
+                    resendRequest(sockets[i], candidates[i]->ai_addr);
+                    sentAt[i] = monotonicNanoseconds();
+                }
+                lastRequestAt = now;
+            }
+            continue;
+        }
+        int ready = poll(pollDescriptors, *requests, (int) ((waitUntil - now + 999999) / 1000000));
+        if (ready == -1 && errno == EINTR) {
+            checkStatsRequest();
+            continue;
+        }
+        if (ready == -1) {
+            handle_error("raceRequests", "Failed to wait for a first response", "poll");
+        }
+
+        // The first candidate to answer serves the transfer
+        for (int i = 0; i < *requests && winner == -1; i++) {
+            if (pollDescriptors[i].revents & POLLIN) {
+                winner = i;
+            }
+        }
+    }
+
+    return winner;
+}
+
+// Function to run the transfer on the socket that won a race (its first packet is still queued)
+void runRaceWinner(int sockfd, const struct addrinfo *address, const char *action, const char *file) {
+    if (strcmp(action, "get") == 0) {
+        // The content cache is checked against the winner: a hit ends the transfer it started
+        if (checkContentCache(address, file)) {
+            cancelMirror(sockfd);
+            cleanup(NULL, sockfd, NULL, NULL);
+            markPhase(PHASE_CLOSE);
+            return;
+        }
+        receiveDownload(sockfd, address, file);
+    } else {
+        sendFile(sockfd, address->ai_addr, inputPath(file));
+    }
+    displaySocketStats();
+
+    // Cleanup before exiting the program
+    cleanup(NULL, sockfd, NULL, NULL);
+    markPhase(PHASE_CLOSE);
+}
+
+// Function to cancel the requests that lost a race and close their sockets
+void cancelRaceLosers(const int sockets[], int requests, int winner) {
+    // The transfer of the winner gave the losers time to answer: their answers are still queued
+    for (int i = 0; i < requests; i++) {
+        if (i != winner) {
+            cancelMirror(sockets[i]);
+            cleanup(NULL, sockets[i], NULL, NULL);
+        }
+    }
+}
+
+// Function to tell the mirrors that answered too late that their transfer is not needed
+void cancelMirror(int sockfd) {
+    // Best effort: a mirror that answers once the socket is closed only gets an ICMP port unreachable
+    char packet[HEADER_SIZE + MAX_BLOCK_SIZE];
+    struct sockaddr_storage peerAddr, cancelledAddr;
+    socklen_t peerAddrLen = sizeof peerAddr;
+    int cancelled = 0;
+    ssize_t received;
+    while ((received = recvfrom(sockfd, packet, sizeof packet, MSG_DONTWAIT, (struct sockaddr *) &peerAddr, &peerAddrLen)) != -1 || errno == EINTR) {
+        // One ERROR per mirror, whatever the number of retransmissions queued (and none in answer to an ERROR)
+        if (received >= HEADER_SIZE && ntohs(*(uint16_t *) packet) != OPCODE_ERROR
+            && !(cancelled && sameAddress((struct sockaddr *) &peerAddr, (struct sockaddr *) &cancelledAddr))) {
+            sendErrorPacket(sockfd, (struct sockaddr *) &peerAddr, ERROR_CODE_UNDEFINED, "Request served by another mirror");
+            cancelledAddr = peerAddr;
+            cancelled = 1;
+        }
+        peerAddrLen = sizeof peerAddr;
+    }
+}
+
+
+
+// -------------------- Pool Functions -------------------- //
+// Function to resolve host and the alternates and add each of their addresses to the pool
+void buildServerPool(const char *host) {
+    addPoolServers(getAddressInfo(host, clientOptions.port));
+    for (int i = 0; i < clientOptions.alternateCount; i++) {
+        addPoolServers(getAddressInfo(clientOptions.alternates[i], clientOptions.port));
+    }
+}
+
+// Function to add every address of a resolution result to the pool (the pool keeps the list)
+void addPoolServers(struct addrinfo *list) {
+    serverPool.lists[serverPool.listCount++] = list;
+
+    for (struct addrinfo *address = list; address != NULL && serverPool.count < MAX_SERVERS; address = address->ai_next) {
+        struct ServerHealth *server = &serverPool.servers[serverPool.count++];
+        memset(server, 0, sizeof(struct ServerHealth));
+        server->address = address;
+        addressToString(address->ai_addr, server->name, sizeof server->name);
+    }
+}
+
+// Function to pick the healthy server with the lowest RTT (untried servers first, then the one due for a retry soonest)
+struct ServerHealth* selectServer() {
+    uint64_t now = monotonicNanoseconds();
+    struct ServerHealth *best = NULL;
+    struct ServerHealth *nextRetry = NULL;
+
+    for (int i = 0; i < serverPool.count; i++) {
+        struct ServerHealth *server = &serverPool.servers[i];
+        if (server->retryAt > now) {
+            if (nextRetry == NULL || server->retryAt < nextRetry->retryAt) {
+                nextRetry = server;
+            }
+            continue;
+        }
+        if (best == NULL || server->smoothedRTT < best->smoothedRTT) {
+            best = server;
+        }
+    }
+
+    return best != NULL ? best : nextRetry;
+}
+
+// Function to run one transfer on the best server, failing over to the next one (waiting for its backoff when none is due)
+void runPoolTransfer(const char *action, const char *file) {
+    for (int attempt = 0; attempt < serverPool.count + FAILOVER_RETRIES; attempt++) {
+        // Every server is backed off: wait until the first one is due instead of contacting it early
+        struct ServerHealth *server = selectServer();
+        uint64_t now = monotonicNanoseconds();
+        if (server->retryAt > now) {
+            uint64_t wait = server->retryAt - now;
+            struct timespec delay = { (time_t) (wait / 1000000000ULL), (long) (wait % 1000000000ULL) };
+            while (nanosleep(&delay, &delay) == -1 && errno == EINTR) {
+                checkStatsRequest();
+            }
+        }
+        if (tryPoolTransfer(server, action, file)) {
+            // Fold the first response time into the RTT and keep the throughput of this transfer
+            uint64_t rtt = currentPhases.marks[PHASE_FIRST_RESPONSE] - currentPhases.marks[PHASE_REQUEST];
+            server->smoothedRTT = server->smoothedRTT == 0 ? rtt : (7 * server->smoothedRTT + rtt) / 8;
+            // (counted by the transfer itself: the local file may be another path, a stream or decompressed)
+            uint64_t transferTime = currentPhases.marks[PHASE_STEADY] - currentPhases.marks[PHASE_REQUEST];
+            if (transferTime > 0 && transferredBytes > 0) {
+                server->throughput = transferredBytes * 1e9 / (double) transferTime;
+            }
+            server->failures = 0;
+            server->retryAt = 0;
+            server->transfers++;
+            return;
+        }
+
+        // Avoid the failed server for a while, longer after each consecutive failure
+        uint64_t backoff = (uint64_t) FAILOVER_BACKOFF_MS << (server->failures < 6 ? server->failures : 6);
+        if (backoff > FAILOVER_MAX_BACKOFF_MS) {
+            backoff = FAILOVER_MAX_BACKOFF_MS;
+        }
+        server->failures++;
+        server->retryAt = monotonicNanoseconds() + backoff * 1000000ULL;
+        fprintf(stderr, "Server %s failed, retrying in %llu ms\n", server->name, (unsigned long long) backoff);
+    }
+
+    handle_error("runPoolTransfer", "Every server of the pool failed (after the retries)", NULL);
+}
+
+// Function to run a transfer on one server of the pool (returns 0 when it failed)
+int tryPoolTransfer(struct ServerHealth *server, const char *action, const char *file) {
+    jmp_buf transferError;
+    volatile int sockfd = -1;
+    char * volatile requestPacket = NULL;
+    volatile int success = 0;
+
+    // handle_error jumps back here instead of exiting, so that the transfer can move to another server
+    errorJump = &transferError;
+    if (setjmp(transferError) == 0) {
+        sockfd = createSocket(server->address);
+        markPhase(PHASE_SOCKET);
+
+        if (strcmp(action, "get") == 0 && checkContentCache(server->address, file)) {
+            // Served from the content cache (the server answered the size check)
+        } else if (strcmp(action, "get") == 0) {
+            requestPacket = sendRRQ(sockfd, server->address->ai_addr, file);
+            markPhase(PHASE_REQUEST);
+            receiveDownload(sockfd, server->address, file);
+        } else {
+            requestPacket = sendWRQ(sockfd, server->address->ai_addr, file);
+            markPhase(PHASE_REQUEST);
+            sendFile(sockfd, server->address->ai_addr, inputPath(file));
+        }
+        displaySocketStats();
+        success = 1;
+    }
+    errorJump = NULL;
+
+    // Cleanup (the address stays in the pool)
+    cleanup(NULL, sockfd, requestPacket, NULL);
+    markPhase(PHASE_CLOSE);
+
+    return success;
+}
+
+// Function to release the resolution results kept by the pool
+void freeServerPool() {
+    for (int i = 0; i < serverPool.listCount; i++) {
+        releaseAddressInfo(serverPool.lists[i]);
+    }
+    serverPool.listCount = 0;
+    serverPool.count = 0;
+}
+
+
+
+// -------------------- Session Cache Functions -------------------- //
+// Function to find a recent resolution of host and port (NULL when it has to be resolved)
+struct addrinfo* lookupResolverCache(const char *host, const char *port) {
+    if (clientOptions.sessionTTL <= 0) {
+        return NULL;
+    }
+
+    uint64_t now = monotonicNanoseconds();
+    for (int i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        struct ResolverEntry *entry = &sessionCache.entries[i];
+        if (entry->list == NULL || strcmp(entry->host, host) != 0 || strcmp(entry->port, port) != 0) {
+            continue;
+        }
+
+        // Reuse the resolution until it expires
+        if (now < entry->expiresAt) {
+            entry->users++;
+            sessionCache.resolverHits++;
+            return entry->list;
+        }
+
+        // Expired: forget it now, or once its last user releases it
+        if (entry->users == 0) {
+            freeaddrinfo(entry->list);
+            entry->list = NULL;
+        } else {
+            entry->host[0] = '\0';
+        }
+        break;
+    }
+
+    sessionCache.resolverMisses++;
+    return NULL;
+}
+
+// Function to keep a resolution for the next transfers (it stays uncached when the cache is full)
+void storeResolverCache(const char *host, const char *port, struct addrinfo *list) {
+    if (clientOptions.sessionTTL <= 0 || strlen(host) >= sizeof sessionCache.entries[0].host || strlen(port) >= sizeof sessionCache.entries[0].port) {
+        return;
+    }
+
+    for (int i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        struct ResolverEntry *entry = &sessionCache.entries[i];
+        if (entry->list == NULL) {
+            strcpy(entry->host, host);
+            strcpy(entry->port, port);
+            entry->list = list;
+            entry->expiresAt = monotonicNanoseconds() + (uint64_t) clientOptions.sessionTTL * 1000000000ULL;
+            entry->users = 1;
+            return;
+        }
+    }
+}
+
+// Function to release a resolution returned by getAddressInfo
+void releaseAddressInfo(struct addrinfo *list) {
+    for (int i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        struct ResolverEntry *entry = &sessionCache.entries[i];
+        if (entry->list == list) {
+            // Free an expired entry once nobody uses it
+            if (--entry->users == 0 && entry->host[0] == '\0') {
+                freeaddrinfo(entry->list);
+                entry->list = NULL;
+            }
+            return;
+        }
+    }
+
+    freeaddrinfo(list);
+}
+
+// Function to take a pre-created socket of the given family (-1 when there is none)
+int takePooledSocket(int family) {
+    sessionCache.families[family == AF_INET6] = family;
+
+    for (int i = 0; i < sessionCache.socketCount; i++) {
+        if (sessionCache.socketFamilies[i] == family) {
+            int sockfd = sessionCache.sockets[i];
+            socketStats = sessionCache.socketSettings[i];
+
+            // Fill the hole with the last socket of the pool
+            sessionCache.socketCount--;
+            sessionCache.sockets[i] = sessionCache.sockets[sessionCache.socketCount];
+            sessionCache.socketFamilies[i] = sessionCache.socketFamilies[sessionCache.socketCount];
+            sessionCache.socketSettings[i] = sessionCache.socketSettings[sessionCache.socketCount];
+            sessionCache.socketHits++;
+            return sockfd;
+        }
+    }
+
+    sessionCache.socketMisses++;
+    return -1;
+}
+
+// Function to pre-create a socket for each address family used so far (called between transfers)
+void refillSocketPool() {
+    if (clientOptions.sessionTTL <= 0) {
+        return;
+    }
+
+    for (int f = 0; f < 2; f++) {
+        int family = sessionCache.families[f];
+        if (family == 0 || sessionCache.socketCount == SOCKET_POOL_SIZE) {
+            continue;
+        }
+
+        // One spare socket per family is enough for the next transfer
+        int spare = 0;
+        for (int i = 0; i < sessionCache.socketCount; i++) {
+            spare |= sessionCache.socketFamilies[i] == family;
+        }
+        if (!spare) {
+            int i = sessionCache.socketCount++;
+            sessionCache.sockets[i] = openSocket(family, AI_SOCKTYPE, AI_PROTOCOL, &sessionCache.socketSettings[i]);
+            sessionCache.socketFamilies[i] = family;
+        }
+    }
+}
+
+// Function to close the pre-created sockets and free the cached resolutions
+void freeSessionCache() {
+    for (int i = 0; i < sessionCache.socketCount; i++) {
+        close(sessionCache.sockets[i]);
+    }
+    sessionCache.socketCount = 0;
+
+    for (int i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        if (sessionCache.entries[i].list != NULL) {
+            freeaddrinfo(sessionCache.entries[i].list);
+            sessionCache.entries[i].list = NULL;
+        }
+    }
+}
+
+
+
+// -------------------- Digest Functions -------------------- //
+// Function to parse -V: an expected digest (its length gives the algorithm), a sidecar file (@file) or an algorithm name
+void prepareDigestCheck(const char *verify) {
+    char value[128];
+
+    // A sidecar file holds the digest as its first word (the format of sha256sum)
+    if (verify[0] == '@') {
+        FILE *sidecar = fopen(verify + 1, "r");
+        if (sidecar == NULL) {
+            handle_error("prepareDigestCheck", "Failed to open the digest file", "fopen");
+        }
+        if (fscanf(sidecar, "%127s", value) != 1) {
+            fclose(sidecar);
+            handle_error("prepareDigestCheck", "The digest file is empty", NULL);
+        }
+        fclose(sidecar);
+    } else {
+        snprintf(value, sizeof value, "%s", verify);
+    }
+
+    if (strcasecmp(value, "crc32c") == 0) {
+        digestCheck.algorithm = DIGEST_CRC32C;
+    } else if (strcasecmp(value, "sha256") == 0) {
+        digestCheck.algorithm = DIGEST_SHA256;
+    } else {
+        size_t length = strlen(value);
+        if ((length != 8 && length != 64) || strspn(value, "0123456789abcdefABCDEF") != length) {
+            handle_error("prepareDigestCheck", "Expected a CRC32C (8 hex digits) or SHA-256 (64 hex digits) digest", NULL);
+        }
+        digestCheck.algorithm = length == 8 ? DIGEST_CRC32C : DIGEST_SHA256;
+        for (size_t i = 0; i <= length; i++) {
+            digestCheck.expected[i] = (char) tolower((unsigned char) value[i]);
+        }
+    }
+}
+
+// Function to check whether the CPU has the CRC32 and SHA-256 instructions
+void detectDigestInstructions() {
+#if defined(__x86_64__) || defined(__i386__)
+    // Use the CRC32 (SSE4.2) and SHA-256 (SHA extensions) instructions when the CPU has them
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        digestCheck.hardwareCRC = (ecx & bit_SSE4_2) != 0;
+        digestCheck.hardwareSHA = (ecx & bit_SSE4_1) != 0 && (ecx & bit_SSSE3) != 0;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        digestCheck.hardwareSHA &= (ebx & bit_SHA) != 0;
+    } else {
+        digestCheck.hardwareSHA = 0;
+    }
+#endif
+}
+
+// Function to start the digest of a transfer
+void initDigest(struct Digest *digest, int algorithm) {
+    static const uint32_t initialState[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memset(digest, 0, sizeof(struct Digest));
+    digest->algorithm = algorithm;
+    digest->crc = 0xffffffff;
+    memcpy(digest->state, initialState, sizeof initialState);
+}
+
+// Function to add the payload of a block to the digest
+void updateDigest(struct Digest *digest, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    digest->length += length;
+
+    if (digest->algorithm == DIGEST_CRC32C) {
+        digest->crc = digestCheck.hardwareCRC ? crc32cHardware(digest->crc, bytes, length) : crc32cSoftware(digest->crc, bytes, length);
+    } else if (digest->algorithm == DIGEST_SHA256) {
+        void (*compress)(uint32_t *, const uint8_t *, size_t) = digestCheck.hardwareSHA ? sha256Hardware : sha256Software;
+
+        // Complete the buffered block first, then digest whole blocks in place and keep the rest
+        if (digest->buffered > 0) {
+            size_t taken = length < 64 - digest->buffered ? length : 64 - digest->buffered;
+            memcpy(digest->buffer + digest->buffered, bytes, taken);
+            digest->buffered += taken;
+            bytes += taken;
+            length -= taken;
+            if (digest->buffered < 64) {
+                return;
+            }
+            compress(digest->state, digest->buffer, 1);
+            digest->buffered = 0;
+        }
+        compress(digest->state, bytes, length / 64);
+        memcpy(digest->buffer, bytes + length / 64 * 64, length % 64);
+        digest->buffered = length % 64;
+    }
+}
+
+// Function to finish the digest and format it in hexadecimal
+void finishDigest(struct Digest *digest, char hex[65]) {
+    if (digest->algorithm == DIGEST_CRC32C) {
+        snprintf(hex, 65, "%08x", digest->crc ^ 0xffffffff);
+        return;
+    }
+
+    // Padding: 0x80, zeros, then the length in bits (big endian) at the end of the last block
+    uint64_t bits = digest->length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t paddingLength = (digest->buffered < 56 ? 56 : 120) - digest->buffered;
+    for (int i = 0; i < 8; i++) {
+        padding[paddingLength + i] = (uint8_t) (bits >> (56 - 8 * i));
+    }
+    updateDigest(digest, padding, paddingLength + 8);
+    digest->length = bits / 8;
+
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex + 8 * i, 9, "%08x", digest->state[i]);
+    }
+}
+
+// Function to display the digest of a transfer and fail when it differs from the expected one
+void checkDigest(const char *location, struct Digest *digest) {
+    if (digest->algorithm == DIGEST_NONE) {
+        return;
+    }
+
+    char hex[65];
+    finishDigest(digest, hex);
+    int verified = digestCheck.expected[0] != '\0' ? strcmp(hex, digestCheck.expected) == 0 : -1;
+    displayDigest(digest, hex, verified);
+    if (verified == 0) {
+        handle_error(location, "The digest of the transferred data does not match the expected one", NULL);
+    }
+}
+
+// Function to update a CRC32C one byte at a time (table of the reflected Castagnoli polynomial)
+uint32_t crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value >> 1) ^ (0x82f63b78 & -(value & 1));
+            }
+            table[i] = value;
+        }
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Function to update a CRC32C eight bytes per instruction (SSE4.2)
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof word);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+#endif
+    for (; length > 0; data++, length--) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+// Function to compress 64-byte blocks with the SHA-256 instructions (four rounds per pair of sha256rnds2)
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256Hardware(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    static const uint32_t k[64] __attribute__((aligned(16))) = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions keep the state as ABEF and CDGH
+    __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[0]), 0xb1);
+    __m128i hgfe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[4]), 0x1b);
+    __m128i abef = _mm_alignr_epi8(dcba, hgfe, 8);
+    __m128i cdgh = _mm_blend_epi16(hgfe, dcba, 0xf0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i savedAbef = abef;
+        __m128i savedCdgh = cdgh;
+        __m128i w[16];
+
+        for (int i = 0; i < 16; i++) {
+            // Message schedule: the first 16 words come from the block, the others from sha256msg1/sha256msg2
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16 * i)), byteSwap);
+            } else {
+                __m128i next = _mm_sha256msg1_epu32(w[i - 4], w[i - 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[i - 1], w[i - 2], 4));
+                w[i] = _mm_sha256msg2_epu32(next, w[i - 1]);
+            }
+
+            __m128i message = _mm_add_epi32(w[i], _mm_load_si128((const __m128i *) &k[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0e));
+        }
+
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    // Back to ABCD and EFGH
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i *) &state[0], _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i *) &state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+#else
+// Function to update a CRC32C (no CRC instruction on this architecture)
+uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    return crc32cSoftware(crc, data, length);
+}
+
+// Function to compress 64-byte blocks (no SHA-256 instructions on this architecture)
+void sha256Hardware(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    sha256Software(state, data, blocks);
+}
+#endif
+
+// Function to compress 64-byte blocks with the portable SHA-256 rounds (FIPS 180-4)
+void sha256Software(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t) data[4 * i] << 24 | (uint32_t) data[4 * i + 1] << 16 | (uint32_t) data[4 * i + 2] << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+#undef ROTR
+}
+
+
+
+// -------------------- Sparse Functions -------------------- //
+// Function to check whether a block only holds zeros (16 bytes per comparison)
+int isZeroBlock(const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // OR the block together and compare the result with zero once
+    __m128i accumulator = _mm_setzero_si128();
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *) (bytes + i)), _mm_loadu_si128((const __m128i *) (bytes + i + 16)));
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *) (bytes + i + 32)), _mm_loadu_si128((const __m128i *) (bytes + i + 48)));
+        accumulator = _mm_or_si128(accumulator, _mm_or_si128(a, b));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(accumulator, _mm_setzero_si128())) != 0xffff) {
+        return 0;
+    }
+#endif
+
+    uint8_t rest = 0;
+    for (; i < length; i++) {
+        rest |= bytes[i];
+    }
+    return rest == 0;
+}
+
+// Function to check whether a stream is a regular file (holes and seeks are only possible there)
+int isRegularFile(FILE *file) {
+    struct stat fileStat;
+    return fstat(fileno(file), &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+}
+
+// Function to prepare the reading of an upload: holes are located when -S is given for a regular file
+void initSparseReader(struct SparseReader *reader, FILE *file) {
+    memset(reader, 0, sizeof(struct SparseReader));
+    if (!clientOptions.sparse || !isRegularFile(file)) {
+        return;
+    }
+
+    // The file system must be able to report holes (EINVAL otherwise)
+    reader->fd = fileno(file);
+    reader->offset = ftello(file);
+    reader->size = lseek(reader->fd, 0, SEEK_END);
+    reader->enabled = reader->offset != -1 && reader->size != -1 && lseek(reader->fd, reader->offset, SEEK_DATA) != -1;
+}
+
+// Function to read the next block of an upload, producing the blocks that lie in a hole as zeros without reading them
+size_t readSparseBlock(struct SparseReader *reader, FILE *file, char *buffer, size_t length) {
+    if (!reader->enabled) {
+        return fread(buffer, 1, length, file);
+    }
+    if (reader->offset >= reader->size) {
+        return 0;
+    }
+    if ((off_t) length > reader->size - reader->offset) {
+        length = reader->size - reader->offset;
+    }
+
+    // Locate the next data region once the previous one has been read (ENXIO: a hole up to the end)
+    if (reader->offset >= reader->nextHole) {
+        off_t data = lseek(reader->fd, reader->offset, SEEK_DATA);
+        reader->nextData = data == -1 ? reader->size : data;
+        off_t hole = data == -1 ? reader->size : lseek(reader->fd, data, SEEK_HOLE);
+        reader->nextHole = hole == -1 ? reader->size : hole;
+    }
+
+    if (reader->offset + (off_t) length <= reader->nextData) {
+        memset(buffer, 0, length);
+        reader->holeBlocks++;
+        reader->holeBytes += length;
+    } else {
+        // Read the whole block (a short read only happens at the end of the file)
+        size_t done = 0;
+        while (done < length) {
+            ssize_t bytesRead = pread(reader->fd, buffer + done, length - done, reader->offset + (off_t) done);
+            if (bytesRead == -1 && errno == EINTR) {
+                continue;
+            }
+            if (bytesRead == -1) {
+                reader->error = 1;
+                return 0;
+            }
+            if (bytesRead == 0) {
+                break;
+            }
+            done += bytesRead;
+        }
+        length = done;
+    }
+
+    reader->offset += length;
+    return length;
+}
+
+
+
+// -------------------- Netascii Functions -------------------- //
+// Function to check whether the transfers use the netascii mode
+int isNetascii() {
+    return strcasecmp(clientOptions.mode, NETASCII_MODE) == 0;
+}
+
+// Function to find the first CR (or LF when withLF is set) of a buffer (returns length when there is none)
+size_t findLineBreak(const uint8_t *data, size_t length, int withLF) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Compare 16 bytes at a time and stop at the first match
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8(withLF ? '\n' : '\r');
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (data + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (data[i] == '\r' || (withLF && data[i] == '\n')) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// Function to read the next netascii block of an upload: LF becomes CR LF and CR becomes CR NUL (short only at the end)
+size_t readNetasciiBlock(struct NetasciiEncoder *encoder, FILE *file, char *buffer, size_t length) {
+    size_t produced = 0;
+
+    // Second byte of a pair that did not fit in the previous block
+    if (encoder->pending != -1 && length > 0) {
+        buffer[produced++] = (char) encoder->pending;
+        encoder->pending = -1;
+    }
+
+    while (produced < length) {
+        if (encoder->position == encoder->length) {
+            encoder->length = fread(encoder->input, 1, sizeof encoder->input, file);
+            encoder->position = 0;
+            updateDigest(encoder->digest, encoder->input, encoder->length);
+            if (encoder->length == 0) {
+                break;
+            }
+        }
+
+        // Copy the bytes up to the next CR or LF as they are
+        const uint8_t *input = encoder->input + encoder->position;
+        size_t available = encoder->length - encoder->position;
+        size_t limit = available < length - produced ? available : length - produced;
+        size_t run = findLineBreak(input, limit, 1);
+        memcpy(buffer + produced, input, run);
+        produced += run;
+        encoder->position += run;
+        if (run == limit) {
+            continue;
+        }
+
+        // Expand the CR or LF into its pair (the second byte may go to the next block)
+        buffer[produced++] = '\r';
+        char second = input[run] == '\n' ? '\n' : '\0';
+        if (produced < length) {
+            buffer[produced++] = second;
+        } else {
+            encoder->pending = (unsigned char) second;
+        }
+        encoder->position++;
+    }
+
+    return produced;
+}
+
+// Function to translate a received netascii block: CR LF becomes LF and CR NUL becomes CR (returns the output length)
+size_t decodeNetascii(struct NetasciiDecoder *decoder, const char *input, size_t length, char *output) {
+    size_t produced = 0;
+    size_t i = 0;
+
+    // A CR that ended the previous block is completed by the first byte of this one
+    if (decoder->pendingCR && length > 0) {
+        decoder->pendingCR = 0;
+        output[produced++] = input[0] == '\n' ? '\n' : '\r';
+        i = input[0] == '\n' || input[0] == '\0';
+    }
+
+    while (i < length) {
+        // Copy the bytes up to the next CR as they are
+        size_t run = findLineBreak((const uint8_t *) input + i, length - i, 0);
+        memcpy(output + produced, input + i, run);
+        produced += run;
+        i += run;
+        if (i == length) {
+            break;
+        }
+
+        // Translate the pair, or keep a CR that is not part of one
+        if (i + 1 == length) {
+            decoder->pendingCR = 1;
+            break;
+        }
+        output[produced++] = input[i + 1] == '\n' ? '\n' : '\r';
+        i += input[i + 1] == '\n' || input[i + 1] == '\0' ? 2 : 1;
+    }
+
+    return produced;
+}
+
+
+
+// -------------------- Server Functions -------------------- //
+// Function to serve the files of root (uploads included) or, for a relay, the cache filled from the upstream server
+void runServer(const char *host, const char *root, const char *upstream) {
+    serverRoot = root;
+    relayUpstream = upstream;
+
+    // Statistics shared by every worker
+    serverStats = mmap(NULL, sizeof(struct ServerStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (serverStats == MAP_FAILED) {
+        handle_error("runServer", "Failed to allocate the shared statistics", "mmap");
+    }
+    memset(serverStats, 0, sizeof(struct ServerStats));
+    atomic_flag_clear(&serverStats->fetchLock);
+
+    // Stop cleanly (with the statistics) on SIGINT or SIGTERM
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = handleStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // One listening socket per worker: with SO_REUSEPORT, the kernel spreads the clients across them
+    int workers = clientOptions.workers > 1 ? clientOptions.workers : 1;
+    int *listenSockets = malloc(workers * sizeof(int));
+    pid_t *workerPids = calloc(workers, sizeof(pid_t));
+    if (listenSockets == NULL || workerPids == NULL) {
+        handle_error("runServer", "Failed to allocate the workers", "malloc");
+    }
+    for (int worker = 0; worker < workers; worker++) {
+        listenSockets[worker] = openListenSocket(host, clientOptions.listenPort);
+    }
+    displayDebugServer(host, workers);
+
+    if (workers == 1) {
+        runServerWorker(listenSockets[0]);
+    } else {
+        for (int worker = 0; worker < workers; worker++) {
+            workerPids[worker] = fork();
+            if (workerPids[worker] == -1) {
+                handle_error("runServer", "Failed to start a worker", "fork");
+            }
+            if (workerPids[worker] == 0) {
+                for (int other = 0; other < workers; other++) {
+                    if (other != worker) {
+                        close(listenSockets[other]);
+                    }
+                }
+                runServerWorker(listenSockets[worker]);
+
+                // Skip the atexit handlers (capture flush) inherited from the parent
+                _exit(EXIT_SUCCESS);
+            }
+        }
+        for (int worker = 0; worker < workers; worker++) {
+            close(listenSockets[worker]);
+        }
+
+        // The workers run until a signal: forward SIGTERM and print the statistics on SIGUSR1
+        int running = workers;
+        while (running > 0) {
+            if (wait(NULL) > 0) {
+                running--;
+                continue;
+            }
+            if (errno != EINTR) {
+                break;
+            }
+            if (statsRequested) {
+                statsRequested = 0;
+                displayServerStats();
+            }
+            if (stopRequested) {
+                for (int worker = 0; worker < workers; worker++) {
+                    kill(workerPids[worker], SIGTERM);
+                }
+            }
+        }
+    }
+
+    free(listenSockets);
+    free(workerPids);
+    displayServerStats();
+    munmap(serverStats, sizeof(struct ServerStats));
+}
+
+// Function to run the event loop of a worker: requests, packets of the transfers and retransmission timers
+void runServerWorker(int listenfd) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        serverSessions[i].sockfd = -1;
+    }
+    serverEpoll = epoll_create1(0);
+    struct epoll_event listenEvent = { .events = EPOLLIN, .data.ptr = NULL };
+    if (serverEpoll == -1 || epoll_ctl(serverEpoll, EPOLL_CTL_ADD, listenfd, &listenEvent) == -1) {
+        handle_error("runServerWorker", "Failed to create the event loop", "epoll");
+    }
+
+    // A failure inside a transfer (e.g. no descriptor left for its socket) only drops that request
+    jmp_buf serverError;
+    errorJump = &serverError;
+    setjmp(serverError);
+
+    while (!stopRequested) {
+        // Wait for a request, a packet or the next retransmission (or a fetch to finish)
+        uint64_t now = monotonicNanoseconds();
+        uint64_t wakeup = now + (uint64_t) TIMEOUT_MS * 1000000ULL;
+        for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+            if (serverSessions[i].sockfd != -1 && serverSessions[i].deadline < wakeup) {
+                wakeup = serverSessions[i].deadline;
+            }
+        }
+        for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+            if (relayFetches[i].filename[0] != '\0' && now + (uint64_t) RELAY_FETCH_POLL_MS * 1000000ULL < wakeup) {
+                wakeup = now + (uint64_t) RELAY_FETCH_POLL_MS * 1000000ULL;
+            }
+        }
+
+        int ready = epoll_wait(serverEpoll, events, SERVER_MAX_EVENTS, wakeup > now ? (int) ((wakeup - now + 999999) / 1000000) : 0);
+        if (ready == -1 && errno != EINTR) {
+            errorJump = NULL;
+            handle_error("runServerWorker", "Failed to wait for packets", "epoll_wait");
+        }
+        if (statsRequested) {
+            statsRequested = 0;
+            if (clientOptions.workers <= 1) {
+                displayServerStats();
+            }
+        }
+
+        // Serve the packets, then the expired retransmission timers and the finished fetches
+        for (int i = 0; i < ready; i++) {
+            struct ServerSession *session = events[i].data.ptr;
+            if (session == NULL) {
+                handleServerRequest(listenfd);
+            } else if (session->sockfd != -1) {
+                handleSessionPacket(session);
+            }
+        }
+        now = monotonicNanoseconds();
+        for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+            if (serverSessions[i].sockfd != -1 && now >= serverSessions[i].deadline) {
+                handleSessionTimeout(&serverSessions[i], now);
+            }
+        }
+        if (relayUpstream != NULL) {
+            collectRelayFetches(listenfd);
+        }
+    }
+    errorJump = NULL;
+
+    // Stop the transfers and the fetches in progress
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (serverSessions[i].sockfd != -1) {
+            closeSession(&serverSessions[i], 0);
+        }
+    }
+    for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+        if (relayFetches[i].pid != 0) {
+            kill(relayFetches[i].pid, SIGTERM);
+            waitpid(relayFetches[i].pid, NULL, 0);
+            releaseSharedFetch(relayFetches[i].filename);
+        }
+        free(relayFetches[i].waiters);
+    }
+    freeHotFiles();
+    close(serverEpoll);
+    close(listenfd);
+}
+
+// Function to open a socket receiving the requests (the wildcard address is IPv6 accepting IPv4 too, or IPv4 only)
+int openListenSocket(const char *host, const char *port) {
+    int families[] = { host == NULL ? AF_INET6 : AF_UNSPEC, AF_INET };
+    int attempts = host == NULL ? 2 : 1;
+
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        struct addrinfo hints, *localAddr;
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = families[attempt];
+        hints.ai_socktype = AI_SOCKTYPE;
+        hints.ai_protocol = AI_PROTOCOL;
+        hints.ai_flags = AI_PASSIVE;
+        int status = getaddrinfo(host, port, &hints, &localAddr);
+        if (status != 0) {
+            if (attempt + 1 < attempts) {
+                continue;
+            }
+            handle_error("openListenSocket", "Failed to resolve the listening address", gai_strerror(status));
+        }
+
+        int listenfd = socket(localAddr->ai_family, localAddr->ai_socktype, localAddr->ai_protocol);
+        forgetCaptureSocket(listenfd);
+        int disabled = 0;
+        int enabled = 1;
+        if (listenfd != -1 && localAddr->ai_family == AF_INET6) {
+            setsockopt(listenfd, IPPROTO_IPV6, IPV6_V6ONLY, &disabled, sizeof disabled);
+        }
+        if (listenfd != -1 && clientOptions.workers > 1) {
+            setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof enabled);
+        }
+        if (listenfd != -1 && bind(listenfd, localAddr->ai_addr, localAddr->ai_addrlen) == 0) {
+            // A request is read only when epoll reports it, so the socket never blocks the loop
+            freeaddrinfo(localAddr);
+            fcntl(listenfd, F_SETFL, O_NONBLOCK);
+            return listenfd;
+        }
+        if (listenfd != -1) {
+            close(listenfd);
+        }
+        freeaddrinfo(localAddr);
+    }
+
+    handle_error("openListenSocket", "Failed to listen on the server port", "bind");
+    return -1;
+}
+
+// Function to answer a request: new transfer, or (relay, file not cached yet) after the fetch in progress or a new fetch
+void handleServerRequest(int listenfd) {
+    struct ServerRequest request;
+    char filename[256];
+    struct RequestOptions options;
+
+    ssize_t length = receivePacket(listenfd, request.packet, sizeof request.packet, &request.peerAddr);
+    if (length < HEADER_SIZE) {
+        return;
+    }
+    request.length = length;
+
+    // Only requests for safe names are served, and a relay is read-only
+    uint16_t opcode = ntohs(*(uint16_t *) request.packet);
+    if (opcode != OPCODE_RRQ && opcode != OPCODE_WRQ) {
+        return;
+    }
+    if (opcode == OPCODE_WRQ && relayUpstream != NULL) {
+        sendErrorPacket(listenfd, (struct sockaddr *) &request.peerAddr, ERROR_CODE_ACCESS, "The relay is read-only");
+        return;
+    }
+    if (!parseRequest(request.packet, request.length, filename, sizeof filename, &options)) {
+        sendErrorPacket(listenfd, (struct sockaddr *) &request.peerAddr, ERROR_CODE_ACCESS, "Invalid request (octet or netascii mode and relative names only)");
+        return;
+    }
+
+    // A client repeating its request is already served or waiting
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (serverSessions[i].sockfd != -1 && sameAddress((struct sockaddr *) &serverSessions[i].peerAddr, (struct sockaddr *) &request.peerAddr)) {
+            return;
+        }
+    }
+    for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+        for (int j = 0; relayFetches[i].filename[0] != '\0' && j < relayFetches[i].waiterCount; j++) {
+            if (sameAddress((struct sockaddr *) &relayFetches[i].waiters[j].peerAddr, (struct sockaddr *) &request.peerAddr)) {
+                return;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&serverStats->requests, 1, memory_order_relaxed);
+
+    // Server, or file already in the relay cache: start the transfer right away
+    if (relayUpstream == NULL || isRelayCached(filename)) {
+        startSession(listenfd, &request);
+        return;
+    }
+
+    // Missing from the relay cache: wait for the fetch of this file in progress (in this worker or another one), or start one
+    struct RelayFetch *fetch = NULL;
+    for (int i = 0; i < RELAY_MAX_FETCHES && fetch == NULL; i++) {
+        if (relayFetches[i].filename[0] != '\0' && strcmp(relayFetches[i].filename, filename) == 0) {
+            fetch = &relayFetches[i];
+            atomic_fetch_add_explicit(&serverStats->coalesced, 1, memory_order_relaxed);
+            displayDebugRequest((struct sockaddr *) &request.peerAddr, opcode, filename, "waiting for the fetch in progress");
+        }
+    }
+    for (int i = 0; i < RELAY_MAX_FETCHES && fetch == NULL; i++) {
+        if (relayFetches[i].filename[0] == '\0') {
+            fetch = &relayFetches[i];
+            fetch->waiterCount = 0;
+            if (claimSharedFetch(filename)) {
+                fetch->pid = startRelayFetch(listenfd, filename);
+                atomic_fetch_add_explicit(&serverStats->fetches, 1, memory_order_relaxed);
+                displayDebugRequest((struct sockaddr *) &request.peerAddr, opcode, filename, "cache miss, fetching");
+            } else {
+                fetch->pid = 0;
+                atomic_fetch_add_explicit(&serverStats->coalesced, 1, memory_order_relaxed);
+                displayDebugRequest((struct sockaddr *) &request.peerAddr, opcode, filename, "waiting for the fetch of another worker");
+            }
+            snprintf(fetch->filename, sizeof fetch->filename, "%s", filename);
+        }
+    }
+    // Clients take an ERROR as fatal: a request that cannot wait is dropped, and queued again when the client repeats it
+    if (fetch != NULL && fetch->waiterCount == fetch->waiterCapacity) {
+        int capacity = fetch->waiterCapacity > 0 ? 2 * fetch->waiterCapacity : RELAY_INITIAL_WAITERS;
+        struct ServerRequest *waiters = realloc(fetch->waiters, capacity * sizeof(struct ServerRequest));
+        if (waiters != NULL) {
+            fetch->waiters = waiters;
+            fetch->waiterCapacity = capacity;
+        }
+    }
+    if (fetch == NULL || fetch->waiterCount == fetch->waiterCapacity) {
+        displayDebugRequest((struct sockaddr *) &request.peerAddr, opcode, filename, "relay busy, dropped");
+        return;
+    }
+    fetch->waiters[fetch->waiterCount++] = request;
+}
+
+// Function to parse a RRQ/WRQ: file name (safe relative path), octet or netascii mode and options (returns 0 when invalid)
+int parseRequest(const char *packet, size_t length, char *filename, size_t filenameSize, struct RequestOptions *options) {
+    // Format of a request packet: opcode (2 bytes) + filename + \0 + mode + \0 + { option + \0 + value + \0 }*
+    const char *current = packet + sizeof(uint16_t);
+    const char *end = packet + length;
+    options->blockSize = options->windowSize = options->rollover = options->tsize = options->timeout = -1;
+
+    const char *nameEnd = memchr(current, '\0', end - current);
+    if (nameEnd == NULL || nameEnd == current) {
+        return 0;
+    }
+    const char *mode = nameEnd + 1;
+    const char *modeEnd = mode < end ? memchr(mode, '\0', end - mode) : NULL;
+    if (modeEnd == NULL || (strcasecmp(mode, TRANSFER_MODE) != 0 && strcasecmp(mode, NETASCII_MODE) != 0)) {
+        return 0;
+    }
+    options->netascii = strcasecmp(mode, NETASCII_MODE) == 0;
+
+    // Names are relative to the served directory (leading slashes are dropped, ".." is refused)
+    while (*current == '/') {
+        current++;
+    }
+    if (*current == '\0' || (size_t) (nameEnd - current) >= filenameSize) {
+        return 0;
+    }
+    memcpy(filename, current, nameEnd - current + 1);
+    if (!isSafeName(filename)) {
+        return 0;
+    }
+
+    // Options (unknown ones are ignored, as RFC 2347 requires)
+    for (current = modeEnd + 1; current < end;) {
+        const char *name = current;
+        const char *optionEnd = memchr(name, '\0', end - name);
+        const char *value = optionEnd != NULL ? optionEnd + 1 : end;
+        const char *valueEnd = value < end ? memchr(value, '\0', end - value) : NULL;
+        if (valueEnd == NULL) {
+            break;
+        }
+
+        if (strcasecmp(name, BLOCK_OPTION) == 0) {
+            options->blockSize = atoi(value);
+        } else if (strcasecmp(name, WINDOW_OPTION) == 0) {
+            options->windowSize = atoi(value);
+        } else if (strcasecmp(name, ROLLOVER_OPTION) == 0) {
+            options->rollover = atoi(value);
+        } else if (strcasecmp(name, TSIZE_OPTION) == 0) {
+            options->tsize = atoi(value);
+        } else if (strcasecmp(name, TIMEOUT_OPTION) == 0) {
+            options->timeout = atoi(value);
+        }
+        current = valueEnd + 1;
+    }
+
+    return 1;
+}
+
+// Function to check that a relative file name stays inside its directory (no ".." component)
+int isSafeName(const char *filename) {
+    for (const char *component = filename; component != NULL; component = strchr(component, '/')) {
+        component += *component == '/';
+        if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to compare the IP address and port of two socket addresses
+int sameAddress(const struct sockaddr *first, const struct sockaddr *second) {
+    if (first->sa_family != second->sa_family) {
+        return 0;
+    }
+    if (first->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *a = (const struct sockaddr_in6 *) first;
+        const struct sockaddr_in6 *b = (const struct sockaddr_in6 *) second;
+        return a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof a->sin6_addr) == 0;
+    }
+    const struct sockaddr_in *a = (const struct sockaddr_in *) first;
+    const struct sockaddr_in *b = (const struct sockaddr_in *) second;
+    return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+// Function to start a transfer: OACK when options were requested, otherwise first window (RRQ) or ACK 0 (WRQ)
+void startSession(int listenfd, const struct ServerRequest *request) {
+    const struct sockaddr *peerAddr = (const struct sockaddr *) &request->peerAddr;
+    char filename[256];
+    struct RequestOptions options;
+    parseRequest(request->packet, request->length, filename, sizeof filename, &options);
+
+    // Find a free session
+    struct ServerSession *session = NULL;
+    for (int i = 0; i < SERVER_MAX_SESSIONS && session == NULL; i++) {
+        if (serverSessions[i].sockfd == -1) {
+            session = &serverSessions[i];
+        }
+    }
+    uint16_t opcode = ntohs(*(uint16_t *) request->packet);
+    if (session == NULL) {
+        sendErrorPacket(listenfd, peerAddr, ERROR_CODE_UNDEFINED, "Server busy, try again");
+        displayDebugRequest(peerAddr, opcode, filename, "server busy");
+        return;
+    }
+
+    // Each transfer gets its own socket, whose port is the server transfer ID (created first: it is the step that may fail)
+    struct SocketStats settings;
+    int sockfd = openSocket(request->peerAddr.ss_family, AI_SOCKTYPE, AI_PROTOCOL, &settings);
+    fcntl(sockfd, F_SETFL, O_NONBLOCK);
+
+    // Map the file to send (shared with the other transfers of the same file), or create the file to receive
+    memset(session, 0, sizeof(struct ServerSession));
+    session->sockfd = -1;
+    session->writing = opcode == OPCODE_WRQ;
+    session->netascii = options.netascii;
+    session->fd = -1;
+    snprintf(session->path, sizeof session->path, "%s/%s", serverRoot, filename);
+    if (session->writing) {
+        char tempPath[1100];
+        snprintf(tempPath, sizeof tempPath, "%s.part.%d.%d", session->path, (int) getpid(), (int) (session - serverSessions));
+        session->fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (session->fd == -1) {
+            close(sockfd);
+            sendErrorPacket(listenfd, peerAddr, ERROR_CODE_ACCESS, "Cannot create the file");
+            displayDebugRequest(peerAddr, opcode, filename, "cannot create the file");
+            atomic_fetch_add_explicit(&serverStats->failures, 1, memory_order_relaxed);
+            return;
+        }
+    } else {
+        session->hotFile = openHotFile(session->path);
+        if (session->hotFile == NULL) {
+            close(sockfd);
+            sendErrorPacket(listenfd, peerAddr, ERROR_CODE_NOT_FOUND, "File not found");
+            displayDebugRequest(peerAddr, opcode, filename, "file not found");
+            atomic_fetch_add_explicit(&serverStats->failures, 1, memory_order_relaxed);
+            return;
+        }
+        session->size = session->hotFile->size;
+        if (session->netascii && !translateSessionFile(session)) {
+            releaseHotFile(session->hotFile);
+            close(sockfd);
+            sendErrorPacket(listenfd, peerAddr, ERROR_CODE_UNDEFINED, "Cannot translate the file to netascii");
+            displayDebugRequest(peerAddr, opcode, filename, "cannot translate the file");
+            atomic_fetch_add_explicit(&serverStats->failures, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    session->sockfd = sockfd;
+    session->peerAddr = request->peerAddr;
+    session->transferOptions.blockSize = DEFAULT_BLOCK_SIZE;
+    session->transferOptions.windowSize = 1;
+    session->transferOptions.rollover = 0;
+    session->transferOptions.transferSize = session->writing ? options.tsize : session->size;
+    session->timeout = (uint64_t) TIMEOUT_MS * 1000000ULL;
+
+    // Acknowledge the supported options, within the limits of the server
+    size_t oackLength = sizeof(uint16_t);
+    *(uint16_t *) session->oack = htons(OPCODE_OACK);
+    if (options.blockSize != -1) {
+        int blockSize = options.blockSize < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : options.blockSize > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : options.blockSize;
+        session->transferOptions.blockSize = blockSize;
+        oackLength += snprintf(session->oack + oackLength, sizeof session->oack - oackLength, "%s%c%d", BLOCK_OPTION, '\0', blockSize) + 1;
+    }
+    if (options.windowSize != -1) {
+        int windowSize = options.windowSize < 1 ? 1 : options.windowSize > MAX_WINDOW_SIZE ? MAX_WINDOW_SIZE : options.windowSize;
+        session->transferOptions.windowSize = windowSize;
+        oackLength += snprintf(session->oack + oackLength, sizeof session->oack - oackLength, "%s%c%d", WINDOW_OPTION, '\0', windowSize) + 1;
+    }
+    if (options.rollover == 0 || options.rollover == 1) {
+        session->transferOptions.rollover = (uint16_t) options.rollover;
+        oackLength += snprintf(session->oack + oackLength, sizeof session->oack - oackLength, "%s%c%d", ROLLOVER_OPTION, '\0', options.rollover) + 1;
+    }
+    if (options.tsize != -1) {
+        oackLength += snprintf(session->oack + oackLength, sizeof session->oack - oackLength, "%s%c%lld", TSIZE_OPTION, '\0', session->transferOptions.transferSize) + 1;
+    }
+    if (options.timeout >= 1 && options.timeout <= 255) {
+        session->timeout = (uint64_t) options.timeout * 1000000000ULL;
+        oackLength += snprintf(session->oack + oackLength, sizeof session->oack - oackLength, "%s%c%d", TIMEOUT_OPTION, '\0', options.timeout) + 1;
+    }
+    session->oackLength = oackLength > sizeof(uint16_t) ? oackLength : 0;
+
+    displayDebugRequest(peerAddr, opcode, filename, session->writing ? "receiving" : "sending");
+
+    // Wake up the loop when a packet of this transfer arrives
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = session };
+    epoll_ctl(serverEpoll, EPOLL_CTL_ADD, session->sockfd, &event);
+
+    // The final block is the first short one (empty when the size is a multiple of the block size)
+    session->baseSequence = 1;
+    session->nextSequence = 1;
+    session->lastSequence = (uint64_t) session->size / session->transferOptions.blockSize + 1;
+    session->deadline = monotonicNanoseconds() + session->timeout;
+    if (session->oackLength != 0) {
+        sendPacket(session->sockfd, session->oack, session->oackLength, peerAddr);
+    } else if (session->writing) {
+        sendSessionACK(session, 0);
+    } else if (fillSessionWindow(session) == -1) {
+        closeSession(session, 0);
+    }
+}
+
+// Function to translate the file of a netascii download once, so that any block can be resent (returns 0 on failure)
+int translateSessionFile(struct ServerSession *session) {
+    if (session->size == 0) {
+        return 1;
+    }
+
+    // Every byte of the file may become a pair
+    size_t capacity = 2 * (size_t) session->size;
+    FILE *file = fmemopen((void *) session->hotFile->data, session->size, "r");
+    session->netasciiData = malloc(capacity);
+    if (file == NULL || session->netasciiData == NULL) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(session->netasciiData);
+        session->netasciiData = NULL;
+        return 0;
+    }
+
+    struct Digest digest;
+    initDigest(&digest, DIGEST_NONE);
+    struct NetasciiEncoder encoder;
+    encoder.position = encoder.length = 0;
+    encoder.pending = -1;
+    encoder.digest = &digest;
+    session->size = readNetasciiBlock(&encoder, file, session->netasciiData, capacity);
+    fclose(file);
+    return 1;
+}
+
+// Function to process a packet of a transfer (ACK, DATA or ERROR)
+void handleSessionPacket(struct ServerSession *session) {
+    char packet[HEADER_SIZE + MAX_BLOCK_SIZE];
+    struct sockaddr_storage peerAddr;
+    ssize_t length = receivePacket(session->sockfd, packet, sizeof packet, &peerAddr);
+    if (length < HEADER_SIZE) {
+        return;
+    }
+
+    // Packets from another port do not belong to this transfer
+    if (!sameAddress((struct sockaddr *) &peerAddr, (struct sockaddr *) &session->peerAddr)) {
+        sendErrorPacket(session->sockfd, (struct sockaddr *) &peerAddr, ERROR_CODE_UNKNOWN_TID, "Unknown transfer ID");
+        return;
+    }
+
+    uint16_t opcode = ntohs(*(uint16_t *) packet);
+    if (opcode == OPCODE_ERROR) {
+        // The client gave up (or only wanted the OACK, e.g. a tsize query)
+        closeSession(session, 0);
+        return;
+    }
+    if (session->writing) {
+        if (opcode == OPCODE_DATA) {
+            receiveSessionData(session, packet, length);
+        }
+        return;
+    }
+    if (opcode != OPCODE_ACK) {
+        return;
+    }
+    uint16_t blockNumber = ntohs(*(uint16_t *) (packet + sizeof(uint16_t)));
+
+    // The ACK of block 0 accepts the OACK
+    if (session->oackLength != 0) {
+        if (blockNumber != 0) {
+            return;
+        }
+        session->oackLength = 0;
+    } else {
+        uint64_t sequence;
+        if (!sequenceFromBlock(blockNumber, session->baseSequence - 1, session->nextSequence - 1, &session->transferOptions, &sequence)) {
+            return;
+        }
+        if (sequence >= session->baseSequence) {
+            // An ACK inside the window reports a gap: resend from the block after it
+            session->baseSequence = sequence + 1;
+            if (session->baseSequence < session->nextSequence) {
+                session->nextSequence = session->baseSequence;
+            }
+        } else if (session->transferOptions.windowSize > 1) {
+            // The client reports a gap: resend from the first missing block
+            session->nextSequence = session->baseSequence;
+        } else {
+            return;
+        }
+        if (session->baseSequence > session->lastSequence) {
+            closeSession(session, 1);
+            return;
+        }
+    }
+
+    session->retries = 0;
+    session->deadline = monotonicNanoseconds() + session->timeout;
+    if (fillSessionWindow(session) == -1) {
+        closeSession(session, 0);
+    }
+}
+
+// Function to write a DATA block of an upload in order, and acknowledge each window and the final block
+void receiveSessionData(struct ServerSession *session, const char *packet, size_t length) {
+    uint16_t blockNumber = ntohs(*(uint16_t *) (packet + sizeof(uint16_t)));
+    size_t dataSize = length - HEADER_SIZE;
+
+    // After the final block, its retransmission means that our last ACK was lost
+    if (session->finished) {
+        if (blockNumber == acknowledgedBlock(session)) {
+            sendSessionACK(session, blockNumber);
+        }
+        return;
+    }
+
+    // The first DATA block accepts the OACK
+    session->oackLength = 0;
+
+    // A block out of order: report the last block in order once, so that the client resends from there
+    if (blockNumber != blockFromSequence(session->baseSequence, &session->transferOptions)) {
+        if (!session->gapAcknowledged) {
+            sendSessionACK(session, acknowledgedBlock(session));
+            session->pendingBlocks = 0;
+            session->gapAcknowledged = 1;
+        }
+        return;
+    }
+    if (dataSize > (size_t) session->transferOptions.blockSize) {
+        sendErrorPacket(session->sockfd, (struct sockaddr *) &session->peerAddr, ERROR_CODE_ILLEGAL, "DATA packet larger than the block size");
+        closeSession(session, 0);
+        return;
+    }
+
+    // A netascii block is translated back to local newlines (a CR ending the upload is kept as it is)
+    const char *data = packet + HEADER_SIZE;
+    size_t writeSize = dataSize;
+    char decoded[MAX_BLOCK_SIZE + 2];
+    if (session->netascii) {
+        writeSize = decodeNetascii(&session->decoder, data, dataSize, decoded);
+        if (dataSize < (size_t) session->transferOptions.blockSize && session->decoder.pendingCR) {
+            decoded[writeSize++] = '\r';
+        }
+        data = decoded;
+    }
+    if (pwrite(session->fd, data, writeSize, session->size) != (ssize_t) writeSize) {
+        sendErrorPacket(session->sockfd, (struct sockaddr *) &session->peerAddr, ERROR_CODE_DISK_FULL, "Failed to write the file");
+        closeSession(session, 0);
+        return;
+    }
+    session->size += writeSize;
+    atomic_fetch_add_explicit(&serverStats->bytesReceived, dataSize, memory_order_relaxed);
+    session->baseSequence++;
+    session->pendingBlocks++;
+    session->gapAcknowledged = 0;
+    session->retries = 0;
+    uint64_t now = monotonicNanoseconds();
+    session->deadline = now + session->timeout;
+
+    // The complete file replaces the previous one before the final ACK, so that a failure can still be reported
+    if (dataSize < (size_t) session->transferOptions.blockSize) {
+        char tempPath[1100];
+        snprintf(tempPath, sizeof tempPath, "%s.part.%d.%d", session->path, (int) getpid(), (int) (session - serverSessions));
+        int closed = close(session->fd);
+        session->fd = -1;
+        if (closed == -1 || rename(tempPath, session->path) == -1) {
+            sendErrorPacket(session->sockfd, (struct sockaddr *) &session->peerAddr, ERROR_CODE_ACCESS, "Failed to store the file");
+            closeSession(session, 0);
+            return;
+        }
+        sendSessionACK(session, blockNumber);
+        session->finished = 1;
+        return;
+    }
+
+    // ACK once per window; a partial window is acknowledged when the client goes quiet (e.g. adaptive window)
+    if (session->pendingBlocks >= session->transferOptions.windowSize) {
+        sendSessionACK(session, blockNumber);
+        session->pendingBlocks = 0;
+    } else {
+        session->deadline = now + (uint64_t) ACK_DELAY_US * 1000ULL;
+    }
+}
+
+// Function to retransmit the OACK, the window or the last ACK of a transfer whose client went quiet
+void handleSessionTimeout(struct ServerSession *session, uint64_t now) {
+    // Upload: the final ACK was not repeated for a whole timeout, or a partial window is waiting for its ACK
+    if (session->finished) {
+        closeSession(session, 1);
+        return;
+    }
+    if (session->writing && session->pendingBlocks > 0) {
+        sendSessionACK(session, acknowledgedBlock(session));
+        session->pendingBlocks = 0;
+        session->deadline = now + session->timeout;
+        return;
+    }
+
+    if (++session->retries > MAX_RETRIES) {
+        closeSession(session, 0);
+        return;
+    }
+    session->deadline = now + session->timeout;
+    if (session->oackLength != 0) {
+        sendPacket(session->sockfd, session->oack, session->oackLength, (struct sockaddr *) &session->peerAddr);
+    } else if (session->writing) {
+        sendSessionACK(session, acknowledgedBlock(session));
+    } else {
+        session->nextSequence = session->baseSequence;
+        if (fillSessionWindow(session) == -1) {
+            closeSession(session, 0);
+        }
+    }
+}
+
+// Function to send the blocks of the window that have not been sent yet, straight from the mapped file (or its translation)
+int fillSessionWindow(struct ServerSession *session) {
+    int blockSize = session->transferOptions.blockSize;
+    const char *data = session->netasciiData != NULL ? session->netasciiData : session->hotFile->data;
+
+    while (session->nextSequence < session->baseSequence + (uint64_t) session->transferOptions.windowSize &&
+           session->nextSequence <= session->lastSequence) {
+        off_t offset = (off_t) (session->nextSequence - 1) * blockSize;
+        size_t length = offset < session->size ? (size_t) (session->size - offset < blockSize ? session->size - offset : blockSize) : 0;
+        uint16_t blockNumber = blockFromSequence(session->nextSequence, &session->transferOptions);
+        if (sendDataBlock(session->sockfd, blockNumber, data + offset, length, (struct sockaddr *) &session->peerAddr) == -1) {
+            // A full socket buffer drops the rest of the window, which the retransmission timer recovers
+            return errno == EAGAIN || errno == ENOBUFS ? 0 : -1;
+        }
+        atomic_fetch_add_explicit(&serverStats->bytesSent, length, memory_order_relaxed);
+        session->nextSequence++;
+    }
+    return 0;
+}
+
+// Function to send a DATA packet whose payload is gathered from memory (no copy into a packet buffer)
+ssize_t sendDataBlock(int sockfd, uint16_t blockNumber, const char *data, size_t length, const struct sockaddr *peerAddr) {
+    uint16_t header[2] = { htons(OPCODE_DATA), htons(blockNumber) };
+    struct iovec iov[2] = { { header, HEADER_SIZE }, { (void *) data, length } };
+    struct msghdr message;
+    memset(&message, 0, sizeof message);
+    message.msg_name = (void *) peerAddr;
+    message.msg_namelen = addressLength(peerAddr);
+    message.msg_iov = iov;
+    message.msg_iovlen = 2;
+
+    ssize_t bytesSent = sendmsg(sockfd, &message, SENDTO_FLAGS);
+    if (bytesSent != -1 && captureRing.records != NULL) {
+        // The capture only keeps the beginning of the payload
+        char snapshot[CAPTURE_SNAPLEN];
+        memcpy(snapshot, header, HEADER_SIZE);
+        memcpy(snapshot + HEADER_SIZE, data, length < CAPTURE_SNAPLEN - HEADER_SIZE ? length : CAPTURE_SNAPLEN - HEADER_SIZE);
+        capturePacket(sockfd, 1, snapshot, HEADER_SIZE + length, peerAddr);
+    }
+    return bytesSent;
+}
+
+// Function to get the block number of the last block received in order (0 before the first one)
+uint16_t acknowledgedBlock(const struct ServerSession *session) {
+    return session->baseSequence == 1 ? 0 : blockFromSequence(session->baseSequence - 1, &session->transferOptions);
+}
+
+// Function to send an ACK packet for a transfer
+void sendSessionACK(struct ServerSession *session, uint16_t blockNumber) {
+    uint16_t ackPacket[2] = { htons(OPCODE_ACK), htons(blockNumber) };
+    sendPacket(session->sockfd, ackPacket, sizeof ackPacket, (struct sockaddr *) &session->peerAddr);
+}
+
+// Function to end a transfer (an incomplete upload is removed)
+void closeSession(struct ServerSession *session, int completed) {
+    if (completed) {
+        atomic_fetch_add_explicit(session->writing ? &serverStats->uploads : &serverStats->downloads, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&serverStats->failures, 1, memory_order_relaxed);
+    }
+    if (session->hotFile != NULL) {
+        releaseHotFile(session->hotFile);
+    }
+    free(session->netasciiData);
+    session->netasciiData = NULL;
+    if (session->fd != -1) {
+        char tempPath[1100];
+        snprintf(tempPath, sizeof tempPath, "%s.part.%d.%d", session->path, (int) getpid(), (int) (session - serverSessions));
+        close(session->fd);
+        unlink(tempPath);
+    }
+
+    // Closing the socket also removes it from epoll
+    forgetCaptureSocket(session->sockfd);
+    close(session->sockfd);
+    session->sockfd = -1;
+}
+
+// Function to get the mapping of a file, shared by the transfers of the same version of it (NULL when it cannot be read)
+struct HotFile* openHotFile(const char *path) {
+    struct stat fileStat;
+    if (stat(path, &fileStat) == -1 || !S_ISREG(fileStat.st_mode)) {
+        return NULL;
+    }
+
+    // Reuse the mapping of this version, otherwise take the least recently used slot (free slots first)
+    uint64_t now = monotonicNanoseconds();
+    struct HotFile *slot = NULL;
+    for (int i = 0; i < HOT_CACHE_SIZE; i++) {
+        struct HotFile *hotFile = &hotFiles[i];
+        int samePath = hotFile->path[0] != '\0' && strcmp(hotFile->path, path) == 0;
+        if (samePath && hotFile->device == fileStat.st_dev && hotFile->inode == fileStat.st_ino && hotFile->size == fileStat.st_size &&
+            hotFile->mtime.tv_sec == fileStat.st_mtim.tv_sec && hotFile->mtime.tv_nsec == fileStat.st_mtim.tv_nsec) {
+            hotFile->users++;
+            hotFile->lastUsed = now;
+            atomic_fetch_add_explicit(&serverStats->hotHits, 1, memory_order_relaxed);
+            return hotFile;
+        }
+        if (hotFile->users == 0 && (slot == NULL || hotFile->lastUsed < slot->lastUsed)) {
+            slot = hotFile;
+        }
+    }
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    // Map the new version read-only (an empty file has no mapping)
+    if (slot->data != NULL) {
+        munmap((void *) slot->data, slot->size);
+    }
+    slot->path[0] = '\0';
+    slot->data = NULL;
+    slot->lastUsed = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fileStat.st_size > 0) {
+        void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        slot->data = data;
+    }
+    close(fd);
+
+    snprintf(slot->path, sizeof slot->path, "%s", path);
+    slot->device = fileStat.st_dev;
+    slot->inode = fileStat.st_ino;
+    slot->size = fileStat.st_size;
+    slot->mtime = fileStat.st_mtim;
+    slot->users = 1;
+    slot->lastUsed = now;
+    return slot;
+}
+
+// Function to release the mapping of a finished transfer (it stays mapped for the next transfers of the file)
+void releaseHotFile(struct HotFile *hotFile) {
+    hotFile->users--;
+}
+
+// Function to unmap every file
+void freeHotFiles() {
+    for (int i = 0; i < HOT_CACHE_SIZE; i++) {
+        if (hotFiles[i].data != NULL) {
+            munmap((void *) hotFiles[i].data, hotFiles[i].size);
+            hotFiles[i].data = NULL;
+        }
+        hotFiles[i].path[0] = '\0';
+        hotFiles[i].lastUsed = 0;
+    }
+}
+
+// Function to note a SIGINT or SIGTERM (the server stops after the current iteration)
+void handleStopSignal(int signum) {
+    (void) signum;
+    stopRequested = 1;
+}
+
+
+
+// -------------------- Relay Functions -------------------- //
+// Function to fetch a file from the upstream server into the cache with the client code, in a child process
+pid_t startRelayFetch(int listenfd, const char *filename) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        releaseSharedFetch(filename);
+        handle_error("startRelayFetch", "Failed to start the fetch", "fork");
+    }
+    if (pid != 0) {
+        return pid;
+    }
+
+    // Close the descriptors of the worker: a copy held here would keep a closed session registered in its epoll and its port bound
+    close(listenfd);
+    close(serverEpoll);
+    serverEpoll = -1;
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (serverSessions[i].sockfd != -1) {
+            if (serverSessions[i].fd != -1) {
+                close(serverSessions[i].fd);
+            }
+            close(serverSessions[i].sockfd);
+            serverSessions[i].sockfd = -1;
+        }
+    }
+
+    // The file is downloaded next to its cache entry and renamed once complete, so that it is never served partially
+    char cachePath[1024];
+    char tempPath[1100];
+    snprintf(cachePath, sizeof cachePath, "%s/%s", serverRoot, filename);
+    snprintf(tempPath, sizeof tempPath, "%s.part.%d", cachePath, (int) getpid());
+
+    // handle_error jumps back here instead of exiting, so that the partial file is removed
+    jmp_buf fetchError;
+    errorJump = &fetchError;
+    if (setjmp(fetchError) != 0) {
+        unlink(tempPath);
+        _exit(EXIT_FAILURE);
+    }
+
+    // The server output stays readable: the fetch itself displays nothing
+    clientOptions.quiet = 1;
+
+    // The cache holds the bytes of the upstream server unchanged (no decompression, digest check, holes or translation)
+    clientOptions.decompress = 0;
+    clientOptions.sparse = 0;
+    clientOptions.mode = TRANSFER_MODE;
+    clientOptions.output = NULL;
+    clientOptions.contentCache = NULL;
+    digestCheck.algorithm = DIGEST_NONE;
+    contentCache.recording = 0;
+    makeParentDirectories(cachePath);
+    struct addrinfo *serverAddr = getAddressInfo(relayUpstream, clientOptions.port);
+    int sockfd = createSocket(serverAddr);
+    char *rrqPacket = sendRRQ(sockfd, serverAddr->ai_addr, filename);
+    receiveFile(sockfd, serverAddr->ai_addr, tempPath);
+    if (rename(tempPath, cachePath) == -1) {
+        handle_error("startRelayFetch", "Failed to move the fetched file into the cache", "rename");
+    }
+    cleanup(serverAddr, sockfd, rrqPacket, NULL);
+
+    // Skip the atexit handlers (capture flush) inherited from the relay
+    _exit(EXIT_SUCCESS);
+}
+
+// Function to start the transfers waiting for the fetches that finished (or to report their failure)
+void collectRelayFetches(int listenfd) {
+    // Fetches of this worker: their child exited (the file is in the cache before the fetch is released)
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+            struct RelayFetch *fetch = &relayFetches[i];
+            if (fetch->filename[0] != '\0' && fetch->pid == pid) {
+                releaseSharedFetch(fetch->filename);
+                finishRelayFetch(listenfd, fetch, WIFEXITED(status) && WEXITSTATUS(status) == 0);
+            }
+        }
+    }
+
+    // Fetches of the other workers: the file is in the cache, or the fetch was released without it
+    for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+        struct RelayFetch *fetch = &relayFetches[i];
+        if (fetch->filename[0] == '\0' || fetch->pid != 0) {
+            continue;
+        }
+        int running = sharedFetchRunning(fetch->filename);
+        if (isRelayCached(fetch->filename)) {
+            finishRelayFetch(listenfd, fetch, 1);
+        } else if (!running) {
+            finishRelayFetch(listenfd, fetch, 0);
+        }
+    }
+}
+
+// Function to serve the requests waiting for a fetch (or to report its failure) and free its slot
+void finishRelayFetch(int listenfd, struct RelayFetch *fetch, int fetched) {
+    for (int j = 0; j < fetch->waiterCount; j++) {
+        if (fetched) {
+            startSession(listenfd, &fetch->waiters[j]);
+        } else {
+            sendErrorPacket(listenfd, (struct sockaddr *) &fetch->waiters[j].peerAddr, ERROR_CODE_NOT_FOUND, "Failed to fetch the file from the upstream server");
+        }
+    }
+    if (!fetched && fetch->pid != 0) {
+        atomic_fetch_add_explicit(&serverStats->failures, 1, memory_order_relaxed);
+    }
+    fetch->filename[0] = '\0';
+    fetch->pid = 0;
+    fetch->waiterCount = 0;
+}
+
+// Function to check whether a file is in the relay cache (a fetched file only appears there once complete)
+int isRelayCached(const char *filename) {
+    char path[1024];
+    snprintf(path, sizeof path, "%s/%s", serverRoot, filename);
+    return access(path, R_OK) == 0;
+}
+
+// Function to record that this worker fetches a file (returns 0 when another worker is already fetching it)
+int claimSharedFetch(const char *filename) {
+    while (atomic_flag_test_and_set_explicit(&serverStats->fetchLock, memory_order_acquire)) {
+        sched_yield();
+    }
+    struct SharedFetch *slot = NULL;
+    int claimed = 1;
+    for (int i = 0; i < RELAY_MAX_FETCHES && claimed; i++) {
+        struct SharedFetch *fetch = &serverStats->fetchTable[i];
+        if (fetch->filename[0] == '\0') {
+            slot = slot == NULL ? fetch : slot;
+        } else if (strcmp(fetch->filename, filename) == 0) {
+            claimed = 0;
+        }
+    }
+
+    // With the table full, the file is fetched without being shared
+    if (claimed && slot != NULL) {
+        snprintf(slot->filename, sizeof slot->filename, "%s", filename);
+        slot->worker = getpid();
+    }
+    atomic_flag_clear_explicit(&serverStats->fetchLock, memory_order_release);
+    return claimed;
+}
+
+// Function to check whether a worker is still fetching a file (the fetch of a worker that died is released)
+int sharedFetchRunning(const char *filename) {
+    while (atomic_flag_test_and_set_explicit(&serverStats->fetchLock, memory_order_acquire)) {
+        sched_yield();
+    }
+    int running = 0;
+    for (int i = 0; i < RELAY_MAX_FETCHES && !running; i++) {
+        struct SharedFetch *fetch = &serverStats->fetchTable[i];
+        if (fetch->filename[0] != '\0' && strcmp(fetch->filename, filename) == 0) {
+            running = kill(fetch->worker, 0) == 0 || errno != ESRCH;
+            if (!running) {
+                fetch->filename[0] = '\0';
+            }
+        }
+    }
+    atomic_flag_clear_explicit(&serverStats->fetchLock, memory_order_release);
+    return running;
+}
+
+// Function to release the fetch of a file by this worker, once the file is in the cache or the fetch failed
+void releaseSharedFetch(const char *filename) {
+    while (atomic_flag_test_and_set_explicit(&serverStats->fetchLock, memory_order_acquire)) {
+        sched_yield();
+    }
+    for (int i = 0; i < RELAY_MAX_FETCHES; i++) {
+        struct SharedFetch *fetch = &serverStats->fetchTable[i];
+        if (fetch->worker == getpid() && strcmp(fetch->filename, filename) == 0) {
+            fetch->filename[0] = '\0';
+        }
+    }
+    atomic_flag_clear_explicit(&serverStats->fetchLock, memory_order_release);
+}
+
+// Function to create the missing directories of a path (for names such as pxelinux.cfg/default)
+void makeParentDirectories(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+}
+
+
+
+// -------------------- Content Cache Functions -------------------- //
+// Function to check whether a download can be served from and stored in the content cache (octet data written to a local file)
+int useContentCache(const char *file) {
+    return clientOptions.contentCache != NULL && !isNetascii() && !clientOptions.decompress && !isStream(outputPath(file));
+}
+
+// Function to check the content cache before any download, whatever the server was chosen by (returns 1 when it served the file)
+int checkContentCache(const struct addrinfo *serverAddr, const char *file) {
+    contentCache.recording = 0;
+    transferredBytes = 0;
+    return useContentCache(file) && conditionalGet(serverAddr, file);
+}
+
+// Function to receive a download and store it in the content cache when checkContentCache asked for it
+void receiveDownload(int sockfd, const struct addrinfo *serverAddr, const char *file) {
+    receiveFile(sockfd, serverAddr->ai_addr, outputPath(file));
+    if (contentCache.recording) {
+        storeCacheEntry(outputPath(file));
+    }
+}
+
+// Function to serve a download from the cache when the remote size is unchanged (returns 0 when the file must be transferred)
+int conditionalGet(const struct addrinfo *serverAddr, const char *file) {
+    const char *output = outputPath(file);
+    contentCache.recording = 0;
+    loadCacheEntry(serverAddr->ai_addr, file);
+    if (contentCache.path[0] == '\0') {
+        return 0;
+    }
+
+    // Without a usable copy there is nothing to compare: the download is stored as it arrives
+    if (contentCache.valid) {
+        // The cached digest must be the expected one (-V) for the copy to be used
+        int digestMatches = digestCheck.expected[0] == '\0' ||
+                            strcmp(digestCheck.algorithm == DIGEST_CRC32C ? contentCache.crc32c : contentCache.sha256, digestCheck.expected) == 0;
+        long long remoteSize = probeTransferSize(serverAddr, file);
+        markPhase(PHASE_FIRST_RESPONSE);
+
+        if (digestMatches && remoteSize == contentCache.size) {
+            const char *method = cloneFile(contentCache.path, output);
+            if (method != NULL) {
+                markPhase(PHASE_STEADY);
+                contentCache.hits++;
+                contentCache.savedBytes += contentCache.size;
+                displayDebugContentCache("hit", method);
+                if (digestCheck.algorithm != DIGEST_NONE) {
+                    struct Digest digest = { .algorithm = digestCheck.algorithm, .length = contentCache.size };
+                    const char *hex = digestCheck.algorithm == DIGEST_CRC32C ? contentCache.crc32c : contentCache.sha256;
+                    displayDigest(&digest, hex, digestCheck.expected[0] != '\0' ? 1 : -1);
+                }
+                return 1;
+            }
+        }
+    }
+
+    // Transfer the file and record its digests on the way (an output linked to the cached copy must not overwrite it)
+    if (sameFile(contentCache.path, output)) {
+        unlink(output);
+    }
+    contentCache.recording = 1;
+    initDigest(&contentCache.crcDigest, DIGEST_CRC32C);
+    initDigest(&contentCache.shaDigest, DIGEST_SHA256);
+    displayDebugContentCache("miss", NULL);
+    return 0;
+}
+
+// Function to locate the cached copy of a file and read its metadata (path left empty when the file cannot be cached)
+void loadCacheEntry(const struct sockaddr *serverAddr, const char *file) {
+    char ipstr[INET6_ADDRSTRLEN];
+    uint16_t port = serverAddr->sa_family == AF_INET6 ? ((const struct sockaddr_in6 *) serverAddr)->sin6_port : ((const struct sockaddr_in *) serverAddr)->sin_port;
+    contentCache.path[0] = '\0';
+    contentCache.valid = 0;
+
+    // The entries are keyed by server and remote file name: <cache>/<address>_<port>/<file>
+    while (*file == '/') {
+        file++;
+    }
+    if (!isSafeName(file) ||
+        snprintf(contentCache.path, sizeof contentCache.path, "%s/%s_%hu/%s", clientOptions.contentCache,
+                 addressToString(serverAddr, ipstr, sizeof ipstr), ntohs(port), file) >= (int) sizeof contentCache.path) {
+        contentCache.path[0] = '\0';
+        return;
+    }
+    snprintf(contentCache.metaPath, sizeof contentCache.metaPath, "%s.meta", contentCache.path);
+
+    // Metadata: size, modification time (ns) and digests of the copy, which must not have changed since
+    FILE *meta = fopen(contentCache.metaPath, "r");
+    if (meta == NULL) {
+        return;
+    }
+    struct stat cachedStat;
+    contentCache.valid = fscanf(meta, "%lld %lld %64s %64s", &contentCache.size, &contentCache.mtime, contentCache.crc32c, contentCache.sha256) == 4 &&
+                         stat(contentCache.path, &cachedStat) == 0 && cachedStat.st_size == contentCache.size &&
+                         (long long) cachedStat.st_mtim.tv_sec * 1000000000LL + cachedStat.st_mtim.tv_nsec == contentCache.mtime;
+    fclose(meta);
+}
+
+// Function to get the size of a remote file with a RRQ carrying only tsize, whose OACK is refused (-1 when unknown)
+long long probeTransferSize(const struct addrinfo *serverAddr, const char *file) {
+    // Format of the probe: opcode (2 bytes) + filename + \0 + mode + \0 + "tsize" + \0 + "0" + \0
+    char request[REQUEST_MAX_SIZE];
+    size_t length = sizeof(uint16_t) + strlen(file) + 1 + strlen(clientOptions.mode) + 1 + strlen(TSIZE_OPTION) + 1 + 2;
+    if (length > sizeof request) {
+        return -1;
+    }
+    *(uint16_t *) request = htons(OPCODE_RRQ);
+    memcpy(request + sizeof(uint16_t), file, strlen(file) + 1);
+    char *current = request + sizeof(uint16_t) + strlen(file) + 1;
+    memcpy(current, clientOptions.mode, strlen(clientOptions.mode) + 1);
+    current += strlen(clientOptions.mode) + 1;
+    memcpy(current, TSIZE_OPTION "\0" "0", strlen(TSIZE_OPTION) + 3);
+
+    // A socket of its own, so that a late retransmission of the probe never reaches the transfer
+    struct SocketStats settings;
+    int sockfd = openSocket(serverAddr->ai_family, serverAddr->ai_socktype, serverAddr->ai_protocol, &settings);
+    char packet[HEADER_SIZE + MAX_BLOCK_SIZE];
+    struct sockaddr_storage peerAddr;
+    struct TransferOptions transferOptions;
+    initTransferOptions(&transferOptions);
+    markPhase(PHASE_REQUEST);
+
+    for (int attempt = 0; attempt <= MAX_RETRIES; attempt++) {
+        if (sendPacket(sockfd, request, length, serverAddr->ai_addr) == -1) {
+            break;
+        }
+        ssize_t bytesRead = receivePacket(sockfd, packet, sizeof packet, &peerAddr);
+        if (isTimeout(bytesRead)) {
+            continue;
+        }
+        if (bytesRead < HEADER_SIZE) {
+            break;
+        }
+
+        uint16_t opcode = ntohs(*(uint16_t *) packet);
+        if (opcode == OPCODE_ERROR) {
+            close(sockfd);
+            handleErrorPacket("probeTransferSize", packet, bytesRead);
+        }
+        if (opcode == OPCODE_OACK && !parseOACK(packet, bytesRead, &transferOptions)) {
+            close(sockfd);
+            handle_error("probeTransferSize", "Server acknowledged an invalid block size or windowsize", NULL);
+        }
+
+        // End the transfer started by the probe (a server without options already sent its first DATA)
+        sendErrorPacket(sockfd, (struct sockaddr *) &peerAddr, ERROR_CODE_UNDEFINED, "Size check only");
+        break;
+    }
+
+    close(sockfd);
+    return transferOptions.transferSize;
+}
+
+// Function to give destination the content of source without copying when possible (returns the method used, NULL on failure)
+const char* cloneFile(const char *source, const char *destination) {
+    // A hard link made by a previous transfer is already up to date
+    if (sameFile(source, destination)) {
+        return "already linked";
+    }
+
+    // The copy is prepared next to the destination and renamed over it
+    char tempPath[1100];
+    snprintf(tempPath, sizeof tempPath, "%s.part.%d", destination, (int) getpid());
+    unlink(tempPath);
+
+    // 1. Reflink: a private copy sharing the blocks (Btrfs, XFS), 2. hard link: the same file, 3. copy
+    const char *method = NULL;
+    int input = open(source, O_RDONLY);
+    if (input == -1) {
+        return NULL;
+    }
+#ifdef FICLONE
+    int output = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (output != -1 && ioctl(output, FICLONE, input) == 0) {
+        method = "reflink";
+    }
+    if (output != -1) {
+        close(output);
+    }
+    if (method == NULL) {
+        unlink(tempPath);
+    }
+#endif
+    if (method == NULL && link(source, tempPath) == 0) {
+        method = "hard link";
+    }
+    if (method == NULL) {
+        static char buffer[CACHE_COPY_SIZE];
+        int output = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ssize_t bytesRead = output != -1 ? 0 : -1;
+        while (output != -1 && (bytesRead = read(input, buffer, sizeof buffer)) > 0 && write(output, buffer, bytesRead) == bytesRead) {
+        }
+        if (output != -1 && close(output) == 0 && bytesRead == 0) {
+            method = "copy";
+        }
+    }
+    close(input);
+
+    if (method == NULL || rename(tempPath, destination) == -1) {
+        unlink(tempPath);
+        return NULL;
+    }
+    return method;
+}
+
+// Function to check whether two paths are links to the same file
+int sameFile(const char *first, const char *second) {
+    struct stat firstStat, secondStat;
+    return stat(first, &firstStat) == 0 && stat(second, &secondStat) == 0 &&
+           firstStat.st_dev == secondStat.st_dev && firstStat.st_ino == secondStat.st_ino;
+}
+
+// Function to store a completed download in the cache, with its size, modification time and digests
+void storeCacheEntry(const char *output) {
+    contentCache.recording = 0;
+    finishDigest(&contentCache.crcDigest, contentCache.crc32c);
+    finishDigest(&contentCache.shaDigest, contentCache.sha256);
+
+    // The metadata is removed first, so that an interrupted update leaves no valid entry
+    char directory[1024];
+    snprintf(directory, sizeof directory, "%s", contentCache.path);
+    makeParentDirectories(directory);
+    unlink(contentCache.metaPath);
+    const char *method = cloneFile(output, contentCache.path);
+    struct stat cachedStat;
+    if (method == NULL || stat(contentCache.path, &cachedStat) == -1) {
+        displayDebugContentCache("not stored", NULL);
+        return;
+    }
+
+    FILE *meta = fopen(contentCache.metaPath, "w");
+    if (meta == NULL) {
+        return;
+    }
+    fprintf(meta, "%lld %lld %s %s\n", (long long) cachedStat.st_size,
+            (long long) cachedStat.st_mtim.tv_sec * 1000000000LL + cachedStat.st_mtim.tv_nsec, contentCache.crc32c, contentCache.sha256);
+    if (fclose(meta) != 0) {
+        unlink(contentCache.metaPath);
+        return;
+    }
+    contentCache.misses++;
+    displayDebugContentCache("stored", method);
+}
+
+
+
+// -------------------- Load Functions -------------------- //
+// Function to run the synthetic clients and report the load achieved against the server
+void runLoad(const struct addrinfo *serverAddr, const char *action, const char *file) {
+    if (strcmp(action, "get") != 0 && strcmp(action, "put") != 0) {
+        handle_error("runLoad", "Load mode supports 'get' and 'put' only", NULL);
+    }
+
+    // Statistics shared by every synthetic client (the histograms are lock-free)
+    struct LoadStats *stats = mmap(NULL, sizeof(struct LoadStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        handle_error("runLoad", "Failed to allocate the shared statistics", "mmap");
+    }
+    memset(stats, 0, sizeof(struct LoadStats));
+
+    // Interleaved per-packet output from many clients would be unreadable
+    clientOptions.quiet = 1;
+    fflush(stdout);
+
+    uint64_t loadStart = monotonicNanoseconds();
+
+    for (int clientIndex = 0; clientIndex < clientOptions.clients; clientIndex++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            handle_error("runLoad", "Failed to start a synthetic client", "fork");
+        }
+        if (pid == 0) {
+            runSyntheticClient(serverAddr, action, file, clientIndex, loadStart, stats);
+
+            // Skip the atexit handlers (capture flush) inherited from the parent
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    // Wait for every synthetic client
+    while (wait(NULL) > 0) {
+    }
+
+    displayLoadStats(stats, monotonicNanoseconds() - loadStart);
+    munmap(stats, sizeof(struct LoadStats));
+}
+
+// Function to run the transfers of one synthetic client at its share of the request rate
+void runSyntheticClient(const struct addrinfo *serverAddr, const char *action, const char *file, int clientIndex, uint64_t loadStart, struct LoadStats *stats) {
+    // Each client issues rate / clients requests per second, staggered across the interval
+    uint64_t interval = clientOptions.rate > 0 ? (uint64_t) (1e9 * clientOptions.clients / clientOptions.rate) : 0;
+    uint64_t nextRequest = loadStart + interval * clientIndex / clientOptions.clients;
+
+    for (int run = 0; run < clientOptions.runs; run++) {
+        // Prepare the socket of the next transfer before its request is due
+        refillSocketPool();
+
+        if (interval != 0) {
+            uint64_t now = monotonicNanoseconds();
+            if (nextRequest > now) {
+                struct timespec delay = { (time_t) ((nextRequest - now) / 1000000000ULL), (long) ((nextRequest - now) % 1000000000ULL) };
+                nanosleep(&delay, NULL);
+            }
+            nextRequest += interval;
+        }
+
+        if (runSyntheticTransfer(serverAddr, action, file, stats)) {
+            atomic_fetch_add_explicit(&stats->transfers, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&stats->errors, 1, memory_order_relaxed);
+        }
+    }
+}
+
+// Function to run one transfer of a synthetic client (returns 0 when it failed)
+int runSyntheticTransfer(const struct addrinfo *serverAddr, const char *action, const char *file, struct LoadStats *stats) {
+    jmp_buf transferError;
+    volatile int sockfd = -1;
+    char * volatile requestPacket = NULL;
+    volatile int success = 0;
+
+    // handle_error jumps back here instead of exiting, so that a failed transfer is only counted
+    errorJump = &transferError;
+    if (setjmp(transferError) == 0) {
+        sockfd = createSocket(serverAddr);
+        beginPhases();
+
+        if (strcmp(action, "get") == 0) {
+            requestPacket = sendRRQ(sockfd, serverAddr->ai_addr, file);
+            markPhase(PHASE_REQUEST);
+            receiveFile(sockfd, serverAddr->ai_addr, "/dev/null");
+        } else {
+            requestPacket = sendWRQ(sockfd, serverAddr->ai_addr, file);
+            markPhase(PHASE_REQUEST);
+            sendFile(sockfd, serverAddr->ai_addr, file);
+        }
+
+        recordLatency(&stats->transferLatency, monotonicNanoseconds() - currentPhases.start);
+        recordLatency(&stats->firstResponseLatency, currentPhases.marks[PHASE_FIRST_RESPONSE] - currentPhases.start);
+        success = 1;
+    }
+    errorJump = NULL;
+
+    if (sockfd != -1) {
+        close(sockfd);
+    }
+    free(requestPacket);
+
+    return success;
+}
+
+
+
+// -------------------- Phase Timing Functions -------------------- //
+// Function to start timing a new transfer
+void beginPhases() {
+    memset(&currentPhases, 0, sizeof currentPhases);
+    currentPhases.start = monotonicNanoseconds();
+}
+
+// Function to record the completion time of a phase
+void markPhase(enum Phase phase) {
+    currentPhases.marks[phase] = monotonicNanoseconds();
+}
+
+// Function to get the duration of a phase (time since the previous phase completed)
+uint64_t phaseDuration(const struct PhaseTimings *timings, enum Phase phase) {
+    uint64_t previous = phase == 0 ? timings->start : timings->marks[phase - 1];
+    return timings->marks[phase] - previous;
+}
+
+// Function to add the phases of a finished transfer to the summary
+void addPhaseSummary(const struct PhaseTimings *timings) {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        uint64_t duration = phaseDuration(timings, phase);
+        phaseSummary.total[phase] += duration;
+        if (phaseSummary.runs == 0 || duration < phaseSummary.min[phase]) {
+            phaseSummary.min[phase] = duration;
+        }
+        if (duration > phaseSummary.max[phase]) {
+            phaseSummary.max[phase] = duration;
+        }
+    }
+    phaseSummary.runs++;
+}
+
+
+
+// -------------------- Core Functions -------------------- //
+// Function to parse command line arguments
+void parseCmdArgs(int argc, char *argv[], char **host, char **file, char **action) {
+    // Parse the options placed before the positional arguments
+    int option;
+    while ((option = getopt(argc, argv, "p:b:R:W:APB:LH:F:T:o:i:zV:Sm:l:C:j:n:c:r:w:q")) != -1) {
+        switch (option) {
+            case 'p':
+                clientOptions.port = optarg;
+                break;
+            case 'b':
+                clientOptions.blockSize = optarg;
+                break;
+            case 'R':
+                clientOptions.rollover = optarg;
+                break;
+            case 'W':
+                clientOptions.windowSize = optarg;
+                break;
+            case 'A':
+                clientOptions.adaptiveWindow = 1;
+                break;
+            case 'P':
+                clientOptions.pacing = 1;
+                break;
+            case 'B':
+                clientOptions.bandwidthCap = parseRate(optarg);
+                break;
+            case 'L':
+                clientOptions.busyPoll = 1;
+                break;
+            case 'H':
+                clientOptions.hedgePercentile = atof(optarg);
+                break;
+            case 'F':
+                if (clientOptions.alternateCount == MAX_SERVERS) {
+                    handle_error("parseCmdArgs", "Too many alternate servers (at most 16)", NULL);
+                }
+                clientOptions.alternates[clientOptions.alternateCount++] = optarg;
+                break;
+            case 'T':
+                clientOptions.sessionTTL = atoi(optarg);
+                break;
+            case 'o':
+                clientOptions.output = optarg;
+                break;
+            case 'i':
+                clientOptions.input = optarg;
+                break;
+            case 'z':
+                clientOptions.decompress = 1;
+                break;
+            case 'V':
+                clientOptions.verify = optarg;
+                break;
+            case 'S':
+                clientOptions.sparse = 1;
+                break;
+            case 'l':
+                clientOptions.listenPort = optarg;
+                break;
+            case 'C':
+                clientOptions.contentCache = optarg;
+                break;
+            case 'j':
+                clientOptions.workers = atoi(optarg);
+                if (clientOptions.workers < 1) {
+                    handle_error("parseCmdArgs", "Number of workers must be at least 1", NULL);
+                }
+                break;
+            case 'm':
+                if (strcasecmp(optarg, TRANSFER_MODE) != 0 && strcasecmp(optarg, NETASCII_MODE) != 0) {
+                    handle_error("parseCmdArgs", "Transfer mode must be octet or netascii", NULL);
+                }
+                clientOptions.mode = optarg;
+                break;
+            case 'n':
+                clientOptions.runs = atoi(optarg);
+                break;
+            case 'c':
+                clientOptions.clients = atoi(optarg);
+                break;
+            case 'r':
+                clientOptions.rate = atof(optarg);
+                break;
+            case 'w':
+                clientOptions.capturePath = optarg;
+                break;
+            case 'q':
+                clientOptions.quiet = 1;
+                break;
+            default:
+                handle_error("parseCmdArgs", USAGE, NULL);
+        }
+    }
+
+    // Check the number of arguments
+    if (argc - optind != 3) {
+        handle_error("parseCmdArgs", USAGE, NULL);
+    }
+
+    // Check the requested rollover block
+    if (clientOptions.rollover != NULL && strcmp(clientOptions.rollover, "0") != 0 && strcmp(clientOptions.rollover, "1") != 0) {
+        handle_error("parseCmdArgs", "Rollover must be 0 or 1", NULL);
+    }
+
+    // Check the requested windowsize
+    if (clientOptions.windowSize != NULL && (atoi(clientOptions.windowSize) < 1 || atoi(clientOptions.windowSize) > MAX_WINDOW_SIZE)) {
+        handle_error("parseCmdArgs", "Window size must be between 1 and 256", NULL);
+    }
+
+    // Check the number of runs and the load settings
+    if (clientOptions.runs < 1) {
+        handle_error("parseCmdArgs", "Number of runs must be at least 1", NULL);
+    }
+    if (clientOptions.clients < 0 || clientOptions.rate < 0) {
+        handle_error("parseCmdArgs", "Clients and rate must not be negative", NULL);
+    }
+    if (clientOptions.bandwidthCap < 0) {
+        handle_error("parseCmdArgs", "Bandwidth cap must be a rate in bytes per second (k, M and G suffixes allowed)", NULL);
+    }
+
+    // Check the hedge percentile
+    if (clientOptions.hedgePercentile <= 0 || clientOptions.hedgePercentile >= 100) {
+        handle_error("parseCmdArgs", "Hedge percentile must be between 0 and 100 (exclusive)", NULL);
+    }
+
+    // Check the requested block size
+    int blockSize = atoi(clientOptions.blockSize);
+    if (blockSize < MIN_BLOCK_SIZE || blockSize > MAX_BLOCK_SIZE) {
+        handle_error("parseCmdArgs", "Block size must be between 8 and 65464", NULL);
+    }
+
+    // Retrieve information from the command-line arguments
+    *host = argv[optind];
+    *file = argv[optind + 1];
+    *action = argv[optind + 2];
+
+    // Display host information
+    displayDebugHostFileInfo(*host, *file);
+}
+
+// Function to parse a rate in bytes per second with an optional k, M or G suffix (-1 when invalid)
+double parseRate(const char *text) {
+    char *end;
+    double rate = strtod(text, &end);
+    if (end == text || rate <= 0) {
+        return -1;
+    }
+
+    switch (*end) {
+        case '\0':
+            return rate;
+        case 'k':
+        case 'K':
+            rate *= 1e3;
+            break;
+        case 'm':
+        case 'M':
+            rate *= 1e6;
+            break;
+        case 'g':
+        case 'G':
+            rate *= 1e9;
+            break;
+        default:
+            return -1;
+    }
+    return end[1] == '\0' ? rate : -1;
+}
+
+// Function to grow a socket buffer to at least the wanted size and return the size granted by the kernel
+int sizeSocketBuffer(int sockfd, int option, int wanted) {
+    int size = 0;
+    socklen_t sizeLength = sizeof size;
+    getsockopt(sockfd, SOL_SOCKET, option, &size, &sizeLength);
+
+    // Never shrink the default buffer; the kernel may cap the request (net.core.rmem_max/wmem_max)
+    if (size < wanted) {
+        setsockopt(sockfd, SOL_SOCKET, option, &wanted, sizeof wanted);
+        sizeLength = sizeof size;
+        getsockopt(sockfd, SOL_SOCKET, option, &size, &sizeLength);
+    }
+
+    return size;
+}
+
+// Function to get server address information using getaddrinfo (or the session cache)
+struct addrinfo* getAddressInfo(const char *host, const char *port) {
+    struct addrinfo hints, *serverAddr;
+
+    // Reuse a recent resolution of the same host
+    serverAddr = lookupResolverCache(host, port);
+    if (serverAddr != NULL) {
+        displayDebugAddressInfo(serverAddr);
+        return serverAddr;
+    }
+
+    // Initialize hints to zero
+    memset(&hints, 0, sizeof hints);
+
+    // Set hints for address family , socket type, protocol, and no special flags
+    hints.ai_family = AI_FAMILY;
+    hints.ai_socktype = AI_SOCKTYPE;
+    hints.ai_protocol = AI_PROTOCOL;
+    hints.ai_flags = AI_FLAGS;
+
+    // Get address information
+    int status = getaddrinfo(host, port, &hints, &serverAddr);
+    if (status != 0) {
+        handle_error("getaddrinfo", "Failed to retrieve address information", gai_strerror(status));
+    }
+    storeResolverCache(host, port, serverAddr);
+
+    // Display address information
+    displayDebugAddressInfo(serverAddr);
+
+    return serverAddr;
+}
+
+// Function to create and reserve a socket for connection to the server
+int createSocket(const struct addrinfo *serverAddr) {
+    // Take a socket pre-created between transfers, or create one (the statistics restart with the socket of the transfer)
+    int sockfd = takePooledSocket(serverAddr->ai_family);
+    if (sockfd == -1) {
+        sockfd = openSocket(serverAddr->ai_family, serverAddr->ai_socktype, serverAddr->ai_protocol, &socketStats);
+    }
+
+    // Display socket information
+    displayDebugSocketCreation(sockfd);
+
+    return sockfd;
+}
+
+// Function to create a socket and apply the buffer sizes and options of the transfers (settings gets what was applied)
+int openSocket(int family, int socktype, int protocol, struct SocketStats *settings) {
+    // Create a socket
+    int sockfd = socket(family, socktype, protocol);
+    if (sockfd == -1) {
+        handle_error("createSocket", "Failed to create socket", "socket");
+    }
+    forgetCaptureSocket(sockfd);
+
+    // Wake up after TIMEOUT_MS without a packet so that the transfer loops can retransmit
+    struct timeval timeout = { TIMEOUT_MS / 1000, (TIMEOUT_MS % 1000) * 1000 };
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) == -1) {
+        handle_error("createSocket", "Failed to set the receive timeout", "setsockopt");
+    }
+
+    // Size the socket buffers for a full window of the largest blocks (twice, for the next window)
+    memset(settings, 0, sizeof(struct SocketStats));
+    int windowSize = clientOptions.windowSize != NULL ? atoi(clientOptions.windowSize) : 1;
+    int wanted = 2 * windowSize * (atoi(clientOptions.blockSize) + HEADER_SIZE);
+    settings->receiveBuffer = sizeSocketBuffer(sockfd, SO_RCVBUF, wanted);
+    settings->sendBuffer = sizeSocketBuffer(sockfd, SO_SNDBUF, wanted);
+
+#ifdef SO_RXQ_OVFL
+    // Have the kernel report the datagrams dropped because the receive queue was full
+    int enable = 1;
+    settings->dropCounter = setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof enable) == 0;
+#endif
+
+#ifdef SO_TIMESTAMPING
+    // Timestamp packets when they reach the kernel (or the NIC) so that RTT samples exclude the client wake-up delay
+    int timestampFlags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    settings->timestamping = setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &timestampFlags, sizeof timestampFlags) == 0;
+#endif
+
+#ifdef SO_BUSY_POLL
+    // Busy-poll mode: also let the kernel poll the device queue (needs CAP_NET_ADMIN above net.core.busy_read)
+    if (clientOptions.busyPoll) {
+        int busyPoll = BUSY_POLL_US;
+        settings->kernelBusyPoll = setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof busyPoll) == 0;
+    }
+#endif
+
+    return sockfd;
+}
+
+// Function to build a RRQ or WRQ packet
+char* buildRequestPacket(uint16_t opcode, const char *filename, size_t *packetSize) {
+    // Format of a request packet: opcode (2 bytes) + filename (variable) + \0 (1 byte) + mode (variable) + \0 (1 byte) + blksize (variable) + \0 (1 byte) + #octets (variable) + \0 (1 byte)
+
+    // Calculate the size of the request packet
+    *packetSize = sizeof(uint16_t) + strlen(filename) + 1 + strlen(clientOptions.mode) + 1 + strlen(BLOCK_OPTION) + 1 + strlen(clientOptions.blockSize) + 1;
+    if (clientOptions.rollover != NULL) {
+        *packetSize += strlen(ROLLOVER_OPTION) + 1 + strlen(clientOptions.rollover) + 1;
+    }
+    if (clientOptions.windowSize != NULL) {
+        *packetSize += strlen(WINDOW_OPTION) + 1 + strlen(clientOptions.windowSize) + 1;
+    }
+
+    // Allocate memory for the request packet
+    char *requestPacket = (char *) malloc(*packetSize);
+    if (requestPacket == NULL) {
+        handle_error("buildRequestPacket", "Failed to allocate memory for request packet", "malloc");
+    }
+
+    // Initialize the current index for building the packet
+    int currentIndex = 0;
+
+    // 1. Set the opcode (RRQ or WRQ) in the request packet
+    requestPacket[currentIndex++] = 0;
+    requestPacket[currentIndex++] = opcode;
+
+    // 2. Copy the filename to the packet
+    strcpy(requestPacket + currentIndex, filename);
+    currentIndex += strlen(filename);
+
+    // 3. Add a null byte after the filename
+    requestPacket[currentIndex++] = '\0';
+
+    // 4. Copy the file transfer mode to the request packet
+    strcpy(requestPacket + currentIndex, clientOptions.mode);
+    currentIndex += strlen(clientOptions.mode);
+
+    // 5. Add a null byte after the mode
+    requestPacket[currentIndex++] = '\0';
+
+    // 6. Copy the block option ("blksize") to the request packet
+    strcpy(requestPacket + currentIndex, BLOCK_OPTION);
+    currentIndex += strlen(BLOCK_OPTION);
+
+    // 7. Add a null byte after the block option
+    requestPacket[currentIndex++] = '\0';
+
+    // 8. Copy the block size to the request packet
+    strcpy(requestPacket + currentIndex, clientOptions.blockSize);
+    currentIndex += strlen(clientOptions.blockSize);
+
+    // 9. Add a null byte after the block size
+    requestPacket[currentIndex++] = '\0';
+
+    // 10. Copy the rollover option and its value, each followed by a null byte, when requested
+    if (clientOptions.rollover != NULL) {
+        strcpy(requestPacket + currentIndex, ROLLOVER_OPTION);
+        currentIndex += strlen(ROLLOVER_OPTION) + 1;
+        strcpy(requestPacket + currentIndex, clientOptions.rollover);
+        currentIndex += strlen(clientOptions.rollover) + 1;
+    }
+
+    // 11. Copy the windowsize option and its value, each followed by a null byte, when requested
+    if (clientOptions.windowSize != NULL) {
+        strcpy(requestPacket + currentIndex, WINDOW_OPTION);
+        currentIndex += strlen(WINDOW_OPTION) + 1;
+        strcpy(requestPacket + currentIndex, clientOptions.windowSize);
+        currentIndex += strlen(clientOptions.windowSize) + 1;
+    }
+
+    return requestPacket;
+}
+
+// Function to send a RRQ (Read Request) to the server
+char* sendRRQ(int sockfd, const struct sockaddr *serverAddr, const char *filename) {
+    // Build the RRQ packet
+    size_t packetSize;
+    char *rrqPacket = buildRequestPacket(OPCODE_RRQ, filename, &packetSize);
+
+    // Send the RRQ packet to the server
+    ssize_t bytesSent = sendPacket(sockfd, rrqPacket, packetSize, serverAddr);
+    if (bytesSent == -1) {
+        free(rrqPacket);
+        handle_error("sendRRQ", "Failed to send RRQ packet to the server", "sendto");
+    }
+    rememberRequest(rrqPacket, packetSize);
+
+    // Display a success message for the RRQ packet transmission
+    displayDebugRRQSuccess();
+
+    return rrqPacket;
+}
+
+// Function to keep a copy of the request just sent, so that it can be sent again if it is lost
+void rememberRequest(const char *packet, size_t length) {
+    lastRequest.length = length <= sizeof lastRequest.packet ? length : 0;
+    memcpy(lastRequest.packet, packet, lastRequest.length);
+}
+
+// Function to send the last request again (the server has not answered it yet)
+void resendRequest(int sockfd, const struct sockaddr *serverAddr) {
+    if (lastRequest.length > 0) {
+        sendPacket(sockfd, lastRequest.packet, lastRequest.length, serverAddr);
+    }
+}
+
+// Function to receive a file (multiple DATA packets) from the server
+void receiveFile(int sockfd, const struct sockaddr *serverAddr, const char *filename) {
+    // Format of a DATA packet: opcode (2 bytes) + block number (2 bytes) + data (variable)
+
+    // Options in effect until the server acknowledges ours
+    struct TransferOptions transferOptions;
+    initTransferOptions(&transferOptions);
+
+    // Buffer for receiving the DATA packet (large enough for any negotiated block size)
+    char dataPacket[HEADER_SIZE + MAX_BLOCK_SIZE];
+
+    // Address of the server transfer ID (TID), which differs from the request port
+    struct sockaddr_storage peerAddr;
+
+    // File pointer for writing the received data (a file, stdout or a descriptor)
+    FILE *file = openOutput(filename);
+    if (file == NULL) {
+        handle_error("receiveFile", "Failed to open the file for writing", "fopen");
+    }
+
+    // Initialize the block number for the first packet and the last acknowledged one
+    uint16_t blockNumber = 1;
+    uint16_t previousBlock = 0;
+
+    // Time at which the previous ACK was sent (0 until the first one)
+    uint64_t ackSentAt = 0;
+
+    // Consecutive timeouts without a new packet
+    int retries = 0;
+
+    // Blocks received since the last ACK (windowsize) and whether the current gap was already reported
+    int pendingBlocks = 0;
+    int gapAcknowledged = 0;
+
+    // Blocks received ahead of the expected one (allocated on the first one)
+    struct ReorderBuffer reorderBuffer;
+    memset(&reorderBuffer, 0, sizeof(struct ReorderBuffer));
+
+    // Decompressor fed by the transfer (-z), 0 until the first block shows compressed data
+    int firstWrite = 1;
+    pid_t decompressor = 0;
+
+    // Digest of the received payload (-V)
+    struct Digest digest;
+    initDigest(&digest, digestCheck.algorithm);
+
+    // Zero blocks not written yet, left as a hole in the file (-S)
+    int sparse = 0;
+    uint64_t holeLength = 0;
+    uint64_t zeroBlocks = 0;
+    uint64_t zeroBytes = 0;
+
+    // Netascii translation of the received blocks (-m netascii)
+    int netascii = isNetascii();
+    struct NetasciiDecoder decoder = { 0 };
+    char decoded[MAX_BLOCK_SIZE + 1];
+    transferredBytes = 0;
+
+    // Continuously receive and acknowledge packets until the transfer is complete
+    int lastBlock = 0;
+    while (!lastBlock) {
+        // Acknowledge a partial window or a gap when the server goes quiet (e.g. its in-flight window is smaller)
+        if ((pendingBlocks > 0 || (reorderBuffer.buffered > 0 && !gapAcknowledged)) && !waitReadable(sockfd, (uint64_t) ACK_DELAY_US * 1000ULL)) {
+            ackSentAt = monotonicNanoseconds();
+            sendACK(sockfd, (struct sockaddr *) &peerAddr, previousBlock);
+            pendingBlocks = 0;
+            gapAcknowledged = reorderBuffer.buffered > 0;
+            continue;
+        }
+
+        // Receive the next packet from the server
+        ssize_t bytesRead = receivePacket(sockfd, dataPacket, sizeof dataPacket, &peerAddr);
+        uint64_t receivedAt = socketStats.lastReceivedAt;
+        if (isTimeout(bytesRead)) {
+            if (++retries > MAX_RETRIES) {
+                abortReceive(file, &reorderBuffer, decompressor);
+                handle_error("receiveFile", "Timed out waiting for DATA packet from the server", NULL);
+            }
+
+            // Repeat the last ACK in case it was lost, or the RRQ while the server has not answered it
+            if (ackSentAt != 0) {
+                sendACK(sockfd, (struct sockaddr *) &peerAddr, previousBlock);
+                pendingBlocks = 0;
+            } else {
+                resendRequest(sockfd, serverAddr);
+            }
+            continue;
+        }
+        if (bytesRead == -1) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handle_error("receiveFile", "Failed to receive DATA packet from the server", "recvfrom");
+        }
+        if (currentPhases.marks[PHASE_FIRST_RESPONSE] == 0) {
+            // The kernel may stamp a fast answer before the request phase was marked
+            currentPhases.marks[PHASE_FIRST_RESPONSE] = receivedAt > currentPhases.marks[PHASE_REQUEST] ? receivedAt : currentPhases.marks[PHASE_REQUEST];
+        }
+        if (bytesRead < HEADER_SIZE) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handle_error("receiveFile", "Received a truncated packet", NULL);
+        }
+
+        // Check the opcode of the received packet
+        uint16_t opcode = ntohs(*(uint16_t *) dataPacket);
+        if (opcode == OPCODE_ERROR) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handleErrorPacket("receiveFile", dataPacket, bytesRead);
+        }
+        if (opcode == OPCODE_OACK) {
+            // Apply the negotiated options and acknowledge them with block 0
+            if (!parseOACK(dataPacket, bytesRead, &transferOptions)) {
+                abortReceive(file, &reorderBuffer, decompressor);
+                handle_error("receiveFile", "Server acknowledged an invalid block size or windowsize", NULL);
+            }
+            ackSentAt = monotonicNanoseconds();
+            sendACK(sockfd, (struct sockaddr *) &peerAddr, 0);
+            continue;
+        }
+        if (opcode != OPCODE_DATA) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handle_error("receiveFile", "Received packet is not a DATA packet", NULL);
+        }
+        if (bytesRead - HEADER_SIZE > transferOptions.blockSize) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handle_error("receiveFile", "Received a DATA packet larger than the block size", NULL);
+        }
+
+        // A block ahead of the expected one (within the window) is kept until the gap is filled
+        uint16_t receivedBlock = ntohs(*(uint16_t *) (dataPacket + sizeof(uint16_t)));
+        int distance = blockDistance(blockNumber, receivedBlock, &transferOptions);
+        if (distance != 0) {
+            if (distance < transferOptions.windowSize) {
+                if (reorderBuffer.data == NULL) {
+                    initReorderBuffer(&reorderBuffer, transferOptions.windowSize, transferOptions.blockSize);
+                }
+                storeReorderBlock(&reorderBuffer, distance, dataPacket + HEADER_SIZE, bytesRead - HEADER_SIZE);
+                displayDebugReceivedDAT(dataPacket, bytesRead);
+                continue;
+            }
+
+            // A retransmission of an acknowledged block means our ACK was lost: repeat it without writing
+            reorderBuffer.duplicates++;
+            if (pendingBlocks == 0 && receivedBlock == previousBlock) {
+                sendACK(sockfd, (struct sockaddr *) &peerAddr, receivedBlock);
+            } else if (transferOptions.windowSize > 1 && !gapAcknowledged) {
+                // Windowed transfer: report the last block in order once so the server resends from there
+                ackSentAt = monotonicNanoseconds();
+                sendACK(sockfd, (struct sockaddr *) &peerAddr, previousBlock);
+                pendingBlocks = 0;
+                gapAcknowledged = 1;
+            }
+            continue;
+        }
+        retries = 0;
+        gapAcknowledged = 0;
+
+        // Record the ACK-to-next-DATA interval (first block of each window)
+        if (ackSentAt != 0 && pendingBlocks == 0 && receivedAt > ackSentAt) {
+            recordLatency(&blockLatency, receivedAt - ackSentAt);
+        }
+
+        // Display debug information about received DATA packet
+        displayDebugReceivedDAT(dataPacket, bytesRead);
+
+        // Calculate the size of the data portion in the received DATA packet
+        size_t dataSize = bytesRead - HEADER_SIZE;
+
+        // Get a pointer to the start of the data portion in the received DATA packet
+        const char *dataStart = dataPacket + HEADER_SIZE;
+
+        // Recognize compressed data from the first block and decompress it while the transfer goes on
+        if (firstWrite && clientOptions.decompress) {
+            file = startDecompressor(file, dataStart, dataSize, &decompressor);
+        }
+        if (firstWrite) {
+            sparse = clientOptions.sparse && decompressor == 0 && isRegularFile(file);
+        }
+        firstWrite = 0;
+
+        // Write the block, then the contiguous blocks that were held behind it
+        do {
+            // Translate netascii back to local newlines
+            const char *writeStart = dataStart;
+            size_t writeSize = dataSize;
+            if (netascii) {
+                writeSize = decodeNetascii(&decoder, dataStart, dataSize, decoded);
+                writeStart = decoded;
+            }
+
+            // Write the data portion to the file (a closed pipe or a full disk ends the transfer), or skip a zero block
+            if (sparse && isZeroBlock(writeStart, writeSize)) {
+                // The empty final block keeps the pending hole, which is added at the end
+                holeLength += writeSize;
+                zeroBlocks += writeSize > 0;
+                zeroBytes += writeSize;
+            } else if ((holeLength > 0 && fseeko(file, (off_t) holeLength, SEEK_CUR) == -1) || fwrite(writeStart, 1, writeSize, file) != writeSize) {
+                abortReceive(file, &reorderBuffer, decompressor);
+                handle_error("receiveFile", "Failed to write the received data", "fwrite");
+            } else {
+                holeLength = 0;
+            }
+            updateDigest(&digest, writeStart, writeSize);
+            transferredBytes += dataSize;
+            if (contentCache.recording) {
+                updateDigest(&contentCache.crcDigest, dataStart, dataSize);
+                updateDigest(&contentCache.shaDigest, dataStart, dataSize);
+            }
+            pendingBlocks++;
+
+            // Move to the next block number (wrapping after 65535)
+            previousBlock = blockNumber;
+            blockNumber = nextBlockNumber(blockNumber, &transferOptions);
+
+            // Check if this is the last packet
+            if (dataSize < (size_t) transferOptions.blockSize) {
+                lastBlock = 1;
+            }
+        } while (!lastBlock && nextReorderBlock(&reorderBuffer, &dataStart, &dataSize));
+
+        // Send the ACK of the last block in order once per window (every block without windowsize) and for the last block
+        if (pendingBlocks >= transferOptions.windowSize || lastBlock) {
+            ackSentAt = monotonicNanoseconds();
+            sendACK(sockfd, (struct sockaddr *) &peerAddr, previousBlock);
+            pendingBlocks = 0;
+        }
+
+        // Serve a pending SIGUSR1 between blocks
+        checkStatsRequest();
+    }
+    markPhase(PHASE_STEADY);
+
+    // Display the reorder buffer statistics
+    if (transferOptions.windowSize > 1) {
+        displayReorderStats(&reorderBuffer);
+    }
+
+    // A CR at the very end was not part of a pair
+    if (decoder.pendingCR) {
+        if ((holeLength > 0 && fseeko(file, (off_t) holeLength, SEEK_CUR) == -1) || fwrite("\r", 1, 1, file) != 1) {
+            abortReceive(file, &reorderBuffer, decompressor);
+            handle_error("receiveFile", "Failed to write the received data", "fwrite");
+        }
+        updateDigest(&digest, "\r", 1);
+        holeLength = 0;
+    }
+
+    // A trailing hole only extends the file
+    if (holeLength > 0 && (fflush(file) != 0 || ftruncate(fileno(file), ftello(file) + (off_t) holeLength) == -1)) {
+        abortReceive(file, &reorderBuffer, decompressor);
+        handle_error("receiveFile", "Failed to extend the file over its last hole", "ftruncate");
+    }
+    if (zeroBlocks > 0) {
+        displaySparseStats("Zero blocks left as holes", zeroBlocks, zeroBytes);
+    }
+
+    // Close the file after writing (this flushes the last buffered blocks), then let the decompressor finish
+    freeReorderBuffer(&reorderBuffer);
+    if (fclose(file) != 0) {
+        handle_error("receiveFile", "Failed to write the received data", "fclose");
+    }
+    if (decompressor != 0) {
+        finishDecompressor(decompressor);
+    }
+    checkDigest("receiveFile", &digest);
+}
+
+// Function to release the output, the reorder buffer and the decompressor of a failed download before reporting it
+void abortReceive(FILE *file, struct ReorderBuffer *reorderBuffer, pid_t decompressor) {
+    // Closing the pipe ends the decompressor, which is reaped so that it does not outlive the transfer
+    fclose(file);
+    freeReorderBuffer(reorderBuffer);
+    if (decompressor != 0) {
+        waitpid(decompressor, NULL, 0);
+    }
+}
+
+// Function to send an ACK packet
+void sendACK(int sockfd, const struct sockaddr *serverAddr, uint16_t blockNumber) {
+    // Create an ACK packet structure
+    struct ACKPacket ackPacket;
+
+    // Set the opcode for ACK
+    ackPacket.opcode = htons(OPCODE_ACK);
+
+    // Set the block number
+    ackPacket.blockNumber = htons(blockNumber);
+
+    // Send the ACK packet to the server
+    ssize_t bytesSent = sendPacket(sockfd, &ackPacket, sizeof(struct ACKPacket), serverAddr);
+
+    // Check if the sendto operation was successful
+    if (bytesSent == -1) {
+        handle_error("sendACK", "Failed to send ACK packet to the server", "sendto");
+    }
+
+    debugDisplayACKSuccess();
+}
+
+// Function to send an ERROR packet (ends the transfer on the peer side)
+void sendErrorPacket(int sockfd, const struct sockaddr *peerAddr, uint16_t errorCode, const char *message) {
+    // Format of an ERROR packet: opcode (2 bytes) + error code (2 bytes) + message + null byte
+    char errorPacket[HEADER_SIZE + 128];
+    size_t messageLength = strnlen(message, sizeof errorPacket - HEADER_SIZE - 1);
+
+    // 1. Set the opcode and the error code
+    *(uint16_t *) errorPacket = htons(OPCODE_ERROR);
+    *(uint16_t *) (errorPacket + sizeof(uint16_t)) = htons(errorCode);
+
+    // 2. Copy the message followed by a null byte
+    memcpy(errorPacket + HEADER_SIZE, message, messageLength);
+    errorPacket[HEADER_SIZE + messageLength] = '\0';
+
+    // Send the ERROR packet (nothing else to do if it is lost)
+    sendPacket(sockfd, errorPacket, HEADER_SIZE + messageLength + 1, peerAddr);
+}
+
+// Function to send a WRQ (Write Request) to the server
+char* sendWRQ(int sockfd, const struct sockaddr *serverAddr, const char *filename) {
+    // Build the WRQ packet
+    size_t packetSize;
+    char *wrqPacket = buildRequestPacket(OPCODE_WRQ, filename, &packetSize);
+
+    // Send the WRQ packet to the server
+    ssize_t bytesSent = sendPacket(sockfd, wrqPacket, packetSize, serverAddr);
+    if (bytesSent == -1) {
+        free(wrqPacket);
+        handle_error("sendWRQ", "Failed to send WRQ packet to the server", "sendto");
+    }
+    rememberRequest(wrqPacket, packetSize);
+
+    // Display a success message for the WRQ packet transmission
+    displayDebugWRQSuccess();
+
+    return wrqPacket;
+}
+
+// Function to receive an ACK (or the OACK answering a WRQ) and return its block number (-1 on timeout, -2 on failure)
+int receiveACK(int sockfd, struct sockaddr_storage *peerAddr, struct TransferOptions *transferOptions, char *failure, size_t failureSize) {
+    // Buffer large enough for an OACK or an ERROR message
+    char responsePacket[HEADER_SIZE + DEFAULT_BLOCK_SIZE];
+
+    // Failures are described in failure and reported by sendFile, once the file and the send ring are released
+    ssize_t bytesReceived = receivePacket(sockfd, responsePacket, sizeof responsePacket, peerAddr);
+    if (isTimeout(bytesReceived)) {
+        return -1;
+    }
+    if (bytesReceived == -1) {
+        snprintf(failure, failureSize, "Failed to receive ACK packet from the server: %s", strerror(errno));
+        return -2;
+    }
+    if (bytesReceived < (ssize_t) sizeof(uint16_t)) {
+        snprintf(failure, failureSize, "Received a truncated packet");
+        return -2;
+    }
+
+    // Check the opcode of the received packet
+    uint16_t opcode = ntohs(*(uint16_t *) responsePacket);
+    if (opcode == OPCODE_ERROR) {
+        formatErrorPacket(responsePacket, bytesReceived, failure, failureSize);
+        return -2;
+    }
+    if (opcode == OPCODE_OACK) {
+        // An OACK stands for the ACK of block 0
+        if (!parseOACK(responsePacket, bytesReceived, transferOptions)) {
+            snprintf(failure, failureSize, "Server acknowledged an invalid block size or windowsize");
+            return -2;
+        }
+        return 0;
+    }
+    if (opcode != OPCODE_ACK || bytesReceived < HEADER_SIZE) {
+        snprintf(failure, failureSize, "Received packet is not an ACK");
+        return -2;
+    }
+
+    // Display debug information about received ACK packet
+    struct ACKPacket *ackPacket = (struct ACKPacket *) responsePacket;
+    displayDebugReceivedACK(ackPacket);
+
+    return ntohs(ackPacket->blockNumber);
+}
+
+// Function to send a file (multiple DATA packets) to the server
+void sendFile(int sockfd, const struct sockaddr *serverAddr, const char *file) {
+    // Format of a DATA packet: opcode (2 bytes) + block number (2 bytes) + data (variable)
+
+    // Options in effect until the server acknowledges ours
+    struct TransferOptions transferOptions;
+    initTransferOptions(&transferOptions);
+
+    // Address of the server transfer ID (TID), which differs from the request port
+    struct sockaddr_storage peerAddr;
+
+    // File pointer for reading the file (a file, stdin or a descriptor, whose length may be unknown)
+    FILE *filePtr = openInput(file);
+    if (filePtr == NULL) {
+        handle_error("sendFile", "Failed to open the file for reading", "fopen");
+    }
+
+    // Wait for the server to accept the WRQ (ACK of block 0 or OACK), sending it again after each timeout
+    char failure[512];
+    int ackedBlock = receiveACK(sockfd, &peerAddr, &transferOptions, failure, sizeof failure);
+    for (int retries = 0; ackedBlock == -1 && retries < MAX_RETRIES; retries++) {
+        resendRequest(sockfd, serverAddr);
+        ackedBlock = receiveACK(sockfd, &peerAddr, &transferOptions, failure, sizeof failure);
+    }
+    if (ackedBlock == -2) {
+        fclose(filePtr);
+        handle_error("receiveACK", failure, NULL);
+    }
+    if (ackedBlock == -1) {
+        fclose(filePtr);
+        handle_error("sendFile", "Timed out waiting for the server to accept the WRQ", NULL);
+    }
+    if (ackedBlock != 0) {
+        fclose(filePtr);
+        handle_error("sendFile", "Server did not acknowledge the WRQ with block 0", NULL);
+    }
+    markPhase(PHASE_FIRST_RESPONSE);
+
+    // Blocks are tracked by sequence (1, 2, ...) so that the window survives block number rollover
+    uint64_t baseSequence = 1;          // Oldest unacknowledged block
+    uint64_t nextSequence = 1;          // Next block to send
+    uint64_t highestSent = 0;           // Highest block sent at least once
+    uint64_t lastSequence = 0;          // Final (short) block, 0 until it has been read
+    uint64_t recoveryBase = 0;          // Base at which the last loss was handled (one reaction per loss)
+    uint64_t firstSentAt[MAX_WINDOW_SIZE];
+    int retransmitted[MAX_WINDOW_SIZE];
+
+    // DATA packets in flight, kept for retransmission (one slot per block of the window)
+    struct SendRing sendRing;
+    initSendRing(&sendRing, transferOptions.windowSize, transferOptions.blockSize);
+
+    // Digest of the sent payload (-V)
+    struct Digest digest;
+    initDigest(&digest, digestCheck.algorithm);
+
+    // Holes of the file, sent as zeros without reading them (-S)
+    struct SparseReader sparseReader;
+    initSparseReader(&sparseReader, filePtr);
+
+    // Netascii translation of the file (-m netascii)
+    int netascii = isNetascii();
+    struct NetasciiEncoder encoder;
+    encoder.position = encoder.length = 0;
+    encoder.pending = -1;
+    encoder.digest = &digest;
+    transferredBytes = 0;
+
+    // Departure times of the DATA packets
+    struct Pacer pacer;
+    initPacer(&pacer, sockfd);
+
+    // Retransmission timer and in-flight window
+    struct RTTEstimator rttEstimator;
+    initRTTEstimator(&rttEstimator);
+    struct WindowController window;
+    initWindowController(&window, transferOptions.windowSize);
+    int retries = 0;
+    uint64_t timerStartedAt = 0;        // Start of the retransmission timer, 0 when stopped
+
+    // Continuously send the window and process the ACKs until the final block is acknowledged
+    while (lastSequence == 0 || baseSequence <= lastSequence) {
+        // Fill the window
+        while (nextSequence < baseSequence + (uint64_t) window.congestionWindow && (lastSequence == 0 || nextSequence <= lastSequence)) {
+            char *dataPacket = sendRingSlot(&sendRing, nextSequence);
+            size_t slot = nextSequence % (uint64_t) sendRing.capacity;
+            if (nextSequence > highestSent) {
+                // Read the data from the file directly behind the header (fread only returns a short block at the end)
+                size_t blockLength = netascii ? readNetasciiBlock(&encoder, filePtr, dataPacket + HEADER_SIZE, transferOptions.blockSize)
+                                              : readSparseBlock(&sparseReader, filePtr, dataPacket + HEADER_SIZE, transferOptions.blockSize);
+                if (blockLength < (size_t) transferOptions.blockSize) {
+                    if (ferror(filePtr) || sparseReader.error) {
+                        fclose(filePtr);
+                        freeSendRing(&sendRing);
+                        handle_error("sendFile", "Failed to read the file", "fread");
+                    }
+                    lastSequence = nextSequence;
+                }
+                if (!netascii) {
+                    updateDigest(&digest, dataPacket + HEADER_SIZE, blockLength);
+                }
+                transferredBytes += blockLength;
+                sendRing.lengths[slot] = blockLength + HEADER_SIZE;
+
+                // 1. Set the opcode for DATA in the DATA packet
+                *(uint16_t *) dataPacket = htons(OPCODE_DATA);
+
+                // 2. Set the block number in the DATA packet
+                *(uint16_t *) (dataPacket + sizeof(uint16_t)) = htons(blockFromSequence(nextSequence, &transferOptions));
+            }
+
+            // Send the DATA packet to the server, no earlier than its paced departure time
+            updatePacingRate(&pacer, &window, &rttEstimator, sendRing.packetSize);
+            uint64_t departure = paceDeparture(&pacer, sendRing.lengths[slot]);
+            uint64_t sentAt = departure != 0 ? departure : monotonicNanoseconds();
+            ssize_t bytesSent = sendPacketAt(sockfd, dataPacket, sendRing.lengths[slot], (struct sockaddr *) &peerAddr, departure);
+            if (bytesSent == -1) {
+                fclose(filePtr);
+                freeSendRing(&sendRing);
+                handle_error("sendFile", "Failed to send DATA packet to the server", "sendto");
+            }
+
+            // Remember when the block first left and whether it was sent again (Karn's rule)
+            if (nextSequence > highestSent) {
+                firstSentAt[slot] = sentAt;
+                retransmitted[slot] = 0;
+                highestSent = nextSequence;
+            } else {
+                retransmitted[slot] = 1;
+                window.retransmissions++;
+            }
+
+            // Display debug information about sent DATA packet
+            displayDebugSentDAT(dataPacket, bytesSent);
+
+            nextSequence++;
+        }
+
+        // Wait for an ACK until the retransmission timeout expires (stale ACKs do not restart the timer)
+        if (timerStartedAt == 0) {
+            timerStartedAt = monotonicNanoseconds();
+        }
+        uint64_t elapsed = monotonicNanoseconds() - timerStartedAt;
+        uint64_t remaining = elapsed < rttEstimator.timeout ? rttEstimator.timeout - elapsed : 0;
+        ackedBlock = waitReadable(sockfd, remaining) ? receiveACK(sockfd, &peerAddr, &transferOptions, failure, sizeof failure) : -1;
+        if (ackedBlock == -2) {
+            fclose(filePtr);
+            freeSendRing(&sendRing);
+            handle_error("receiveACK", failure, NULL);
+        }
+        if (ackedBlock == -1) {
+            if (++retries > MAX_RETRIES) {
+                fclose(filePtr);
+                freeSendRing(&sendRing);
+                handle_error("sendFile", "Timed out waiting for ACK packet from the server", NULL);
+            }
+
+            // Timeout: back off the timer, shrink the window and resend from the oldest unacknowledged block
+            backoffRTTEstimator(&rttEstimator);
+            shrinkWindow(&window);
+            nextSequence = baseSequence;
+            recoveryBase = baseSequence;
+            timerStartedAt = 0;
+            continue;
+        }
+
+        // Locate the acknowledged block among the blocks sent so far (ACKs outside of them are stale)
+        uint64_t ackedSequence = 0;
+        if (!sequenceFromBlock((uint16_t) ackedBlock, baseSequence - 1, highestSent, &transferOptions, &ackedSequence)) {
+            continue;
+        }
+
+        if (ackedSequence == baseSequence - 1) {
+            // Duplicate ACK: with a window, the receiver is asking for the blocks after it again
+            if (window.ceiling > 1 && recoveryBase != baseSequence) {
+                shrinkWindow(&window);
+                nextSequence = baseSequence;
+                recoveryBase = baseSequence;
+                timerStartedAt = 0;
+            }
+            continue;
+        }
+        retries = 0;
+
+        // Feed the timer with the acknowledged block and record its DATA-to-ACK interval (from the ACK arrival time)
+        uint64_t now = socketStats.lastReceivedAt;
+        size_t slot = ackedSequence % (uint64_t) sendRing.capacity;
+        if (now > firstSentAt[slot]) {
+            if (!retransmitted[slot]) {
+                updateRTTEstimator(&rttEstimator, now - firstSentAt[slot]);
+            }
+            recordLatency(&blockLatency, now - firstSentAt[slot]);
+        }
+
+        // Slide the window and restart the timer for the blocks still in flight
+        baseSequence = ackedSequence + 1;
+        timerStartedAt = 0;
+        if (nextSequence < baseSequence) {
+            // The ACK covers blocks sent before a rewind: skip them
+            nextSequence = baseSequence;
+        }
+        if (ackedSequence < nextSequence - 1) {
+            // Fast retransmit: the receiver stopped inside the window, resend from the block after it out of the send ring
+            shrinkWindow(&window);
+            nextSequence = baseSequence;
+            recoveryBase = baseSequence;
+        } else {
+            // The whole window arrived: grow by one block (additive increase)
+            growWindow(&window);
+        }
+
+        // Serve a pending SIGUSR1 between windows
+        checkStatsRequest();
+    }
+    markPhase(PHASE_STEADY);
+
+    // Display the window controller statistics
+    if (window.ceiling > 1) {
+        displayWindowStats(&window, &rttEstimator);
+    }
+    if (pacer.enabled) {
+        displayPacerStats(&pacer);
+    }
+
+    if (sparseReader.holeBlocks > 0) {
+        displaySparseStats("Blocks read from holes", sparseReader.holeBlocks, sparseReader.holeBytes);
+    }
+
+    // Close the file after sending all DATA packets
+    fclose(filePtr);
+    freeSendRing(&sendRing);
+    checkDigest("sendFile", &digest);
+}
+
+
+
+// -------------------- Debug -------------------- //
+// Function to display debug information about host and file
+void displayDebugHostFileInfo(const char *host, const char *file) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- parseCmdArgs -----\n");
+    printf("Host: %s\n", host);
+    printf("File: %s\n", file);
+    printf("\n");
+}
+
+// Function to display debug information about address details
+void displayDebugAddressInfo(const struct addrinfo *serverAddr) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    char ipstr[INET6_ADDRSTRLEN];
+    addressToString(serverAddr->ai_addr, ipstr, sizeof ipstr);
+
+    printf("----- getAddressInfo -----\n");
+    printf("Address Family: %d\n", serverAddr->ai_family);
+    printf("Socket Type: %d\n", serverAddr->ai_socktype);
+    printf("Protocol: %d\n", serverAddr->ai_protocol);
+    printf("Flags: %d\n", serverAddr->ai_flags);
+    printf("IP Address: %s\n", ipstr);
+    for (const struct addrinfo *address = serverAddr->ai_next; address != NULL; address = address->ai_next) {
+        printf("Other Address: %s\n", addressToString(address->ai_addr, ipstr, sizeof ipstr));
+    }
+    printf("\n");
+}
+
+// Function to display debug information about socket creation
+void displayDebugSocketCreation(int sockfd) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- createSocket -----\n");
+    printf("Socket Descriptor: %d\n", sockfd);
+    printf("Receive Buffer: %d bytes\n", socketStats.receiveBuffer);
+    printf("Send Buffer: %d bytes\n", socketStats.sendBuffer);
+    if (clientOptions.busyPoll) {
+        printf("Busy Poll: %d us (%s)\n", BUSY_POLL_US, socketStats.kernelBusyPoll ? "SO_BUSY_POLL" : "user space only");
+    }
+    printf("\n");
+}
+
+// Function to display debug information about the successful RRQ packet transmission
+void displayDebugRRQSuccess() {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- sendRRQ -----\n");
+    printf("RRQ packet sent successfully.\n");
+    printf("\n");
+}
+
+// Function to display debug information about received DATA packet
+void displayDebugReceivedDAT(const char *dataPacket, ssize_t bytesRead) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    // Display received data
+    printf("----- receiveFile -----\n");
+    printf("Received Data (length: %zd bytes): ", bytesRead - HEADER_SIZE);
+    fwrite(dataPacket + HEADER_SIZE, 1, bytesRead - HEADER_SIZE, stdout);
+    printf("\n\n");
+}
+
+// Function to display a debug success message for ACK packet transmission
+void debugDisplayACKSuccess() {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- sendACK -----\n");
+    printf("ACK packet sent successfully.\n");
+    printf("\n");
+}
+
+// Function to display debug information about the successful WRQ packet transmission
+void displayDebugWRQSuccess() {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- sendWRQ -----\n");
+    printf("WRQ packet sent successfully.\n");
+    printf("\n");
+}
+
+// Function to display debug information about sent DATA packet
+void displayDebugSentDAT(const char *dataPacket, ssize_t bytesSent) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    // Display sent data
+    printf("----- sendFile -----\n");
+    printf("Sent Data (length: %zd bytes):\n", bytesSent - HEADER_SIZE);
+    fwrite(dataPacket + HEADER_SIZE, 1, bytesSent - HEADER_SIZE, stdout);
+    printf("\n\n");
+}
+
+// Function to display debug information about received ACK packet
+void displayDebugReceivedACK(const struct ACKPacket *ackPacket) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- sendFile -----\n");
+    printf("Received ACK:\n");
+    printf("Opcode: %hu\n", ntohs(ackPacket->opcode));
+    printf("Block Number: %hu\n", ntohs(ackPacket->blockNumber));
+    printf("\n");
+}
+
+// Function to display the options acknowledged by the server
+void displayDebugOACK(const struct TransferOptions *transferOptions) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- parseOACK -----\n");
+    printf("Block Size: %d\n", transferOptions->blockSize);
+    printf("Rollover: %hu\n", transferOptions->rollover);
+    printf("Window Size: %d\n", transferOptions->windowSize);
+    printf("\n");
+}
+
+// Function to display the latency percentiles (always shown, even with -q)
+void displayLatencyHistogram(const struct LatencyHistogram *histogram) {
+    printf("----- latencyHistogram -----\n");
+    printf("Samples: %llu\n", (unsigned long long) atomic_load_explicit(&histogram->totalCount, memory_order_relaxed));
+    printf("p50: %.1f us\n", latencyPercentile(histogram, 50.0) / 1000.0);
+    printf("p90: %.1f us\n", latencyPercentile(histogram, 90.0) / 1000.0);
+    printf("p99: %.1f us\n", latencyPercentile(histogram, 99.0) / 1000.0);
+    printf("p99.9: %.1f us\n", latencyPercentile(histogram, 99.9) / 1000.0);
+    printf("Max: %.1f us\n", atomic_load_explicit(&histogram->maxValue, memory_order_relaxed) / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+
+// Function to display the duration of each phase of the last transfer (always shown, even with -q)
+void displayPhaseTimings(const struct PhaseTimings *timings) {
+    printf("----- phaseTimings -----\n");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        printf("%s: %.1f us\n", phaseNames[phase], phaseDuration(timings, phase) / 1000.0);
+    }
+    printf("Time to first byte: %.1f us\n", (timings->marks[PHASE_FIRST_RESPONSE] - timings->start) / 1000.0);
+    printf("Total: %.1f us\n", (timings->marks[PHASE_CLOSE] - timings->start) / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the phase durations aggregated across runs
+void displayPhaseSummary(const struct PhaseSummary *summary) {
+    printf("----- phaseSummary -----\n");
+    printf("Runs: %d\n", summary->runs);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        printf("%s: min %.1f / mean %.1f / max %.1f us\n", phaseNames[phase],
+               summary->min[phase] / 1000.0,
+               summary->total[phase] / 1000.0 / summary->runs,
+               summary->max[phase] / 1000.0);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+
+// Function to display how many datagrams were written to the pcap file
+void displayDebugCaptureFlush(uint64_t captured, uint64_t overwritten) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- flushCaptureRing -----\n");
+    printf("Capture File: %s\n", clientOptions.capturePath);
+    printf("Datagrams Written: %llu\n", (unsigned long long) captured);
+    printf("Datagrams Overwritten: %llu\n", (unsigned long long) overwritten);
+    printf("\n");
+}
+
+
+// Function to display the load achieved by the synthetic clients (always shown, even with -q)
+void displayLoadStats(const struct LoadStats *stats, uint64_t elapsed) {
+    uint64_t transfers = atomic_load_explicit(&stats->transfers, memory_order_relaxed);
+    uint64_t errors = atomic_load_explicit(&stats->errors, memory_order_relaxed);
+    double seconds = elapsed / 1e9;
+
+    printf("----- loadGenerator -----\n");
+    printf("Clients: %d\n", clientOptions.clients);
+    printf("Duration: %.3f s\n", seconds);
+    printf("Transfers: %llu (%.1f/s)\n", (unsigned long long) transfers, seconds > 0 ? transfers / seconds : 0.0);
+    printf("Errors: %llu (%.2f%%)\n", (unsigned long long) errors,
+           transfers + errors > 0 ? 100.0 * errors / (transfers + errors) : 0.0);
+    printf("Transfer p50/p90/p99/max: %.1f / %.1f / %.1f / %.1f us\n",
+           latencyPercentile(&stats->transferLatency, 50.0) / 1000.0,
+           latencyPercentile(&stats->transferLatency, 90.0) / 1000.0,
+           latencyPercentile(&stats->transferLatency, 99.0) / 1000.0,
+           atomic_load_explicit(&stats->transferLatency.maxValue, memory_order_relaxed) / 1000.0);
+    printf("First response p50/p90/p99/max: %.1f / %.1f / %.1f / %.1f us\n",
+           latencyPercentile(&stats->firstResponseLatency, 50.0) / 1000.0,
+           latencyPercentile(&stats->firstResponseLatency, 90.0) / 1000.0,
+           latencyPercentile(&stats->firstResponseLatency, 99.0) / 1000.0,
+           atomic_load_explicit(&stats->firstResponseLatency.maxValue, memory_order_relaxed) / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the state of the in-flight window at the end of a windowed upload (always shown, even with -q)
+void displayWindowStats(const struct WindowController *window, const struct RTTEstimator *estimator) {
+    printf("----- windowController -----\n");
+    printf("Window Size: %d (final in-flight window: %d)\n", window->ceiling, window->congestionWindow);
+    printf("Window Decreases: %llu\n", (unsigned long long) window->decreases);
+    printf("Retransmissions: %llu\n", (unsigned long long) window->retransmissions);
+    printf("Smoothed RTT: %.1f us (timeout %.1f us)\n", estimator->smoothedRTT / 1000.0, estimator->timeout / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display how many blocks the reorder buffer kept or dropped during a windowed download (always shown, even with -q)
+void displayReorderStats(const struct ReorderBuffer *buffer) {
+    printf("----- reorderBuffer -----\n");
+    printf("Out of Order Blocks: %llu\n", (unsigned long long) buffer->reordered);
+    printf("Duplicate Blocks: %llu\n", (unsigned long long) buffer->duplicates);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display how the DATA packets of an upload were paced (always shown, even with -q)
+void displayPacerStats(const struct Pacer *pacer) {
+    printf("----- pacer -----\n");
+    printf("Mode: %s\n", pacer->kernelPacing ? "SO_TXTIME" : "token bucket");
+    printf("Final Rate: %.2f MB/s\n", pacer->rate / 1e6);
+    if (clientOptions.bandwidthCap > 0) {
+        printf("Bandwidth Cap: %.2f MB/s\n", clientOptions.bandwidthCap / 1e6);
+    }
+    printf("Waits: %llu\n", (unsigned long long) pacer->sleeps);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the client wake-up delays measured from the kernel receive timestamps
+void displayWakeupHistogram(const struct LatencyHistogram *histogram) {
+    uint64_t samples = atomic_load_explicit(&histogram->totalCount, memory_order_relaxed);
+    if (samples == 0) {
+        return;
+    }
+
+    printf("----- wakeupHistogram -----\n");
+    printf("Timestamps: %s\n", socketStats.timestamping == 2 ? "software (NIC hardware stamps recorded raw)" : "software");
+    printf("Samples: %llu\n", (unsigned long long) samples);
+    printf("p50: %.1f us\n", latencyPercentile(histogram, 50.0) / 1000.0);
+    printf("p99: %.1f us\n", latencyPercentile(histogram, 99.0) / 1000.0);
+    printf("Max: %.1f us\n", atomic_load_explicit(&histogram->maxValue, memory_order_relaxed) / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display debug information about the mirror that won a hedged request
+void displayDebugHedge(int winner, int requests, uint64_t delay, uint64_t firstResponse) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- hedgedGet -----\n");
+    printf("Hedge Delay: %.1f us\n", delay / 1000.0);
+    printf("Mirrors Asked: %d of %d\n", requests, hedgeStats.mirrorCount);
+    printf("Winner: %s (first response in %.1f us)\n", hedgeStats.mirrors[winner], firstResponse / 1000.0);
+    printf("\n");
+}
+
+// Function to display how the hedged requests were served across the runs
+void displayHedgeSummary() {
+    printf("----- hedgeSummary -----\n");
+    printf("Transfers: %llu (hedged RRQs: %llu)\n", (unsigned long long) hedgeStats.transfers, (unsigned long long) hedgeStats.hedges);
+    for (int i = 0; i < hedgeStats.mirrorCount; i++) {
+        printf("Mirror %s: %llu wins\n", hedgeStats.mirrors[i], (unsigned long long) hedgeStats.wins[i]);
+    }
+    printf("First response p50/p%g: %.1f / %.1f us\n", clientOptions.hedgePercentile,
+           latencyPercentile(&hedgeStats.firstResponse, 50.0) / 1000.0,
+           latencyPercentile(&hedgeStats.firstResponse, clientOptions.hedgePercentile) / 1000.0);
+    printf("Next Hedge Delay: %.1f us\n", hedgeDelay() / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the health table of the server pool
+void displayServerPool() {
+    uint64_t now = monotonicNanoseconds();
+
+    printf("----- serverPool -----\n");
+    for (int i = 0; i < serverPool.count; i++) {
+        const struct ServerHealth *server = &serverPool.servers[i];
+        printf("%s: %llu transfers, RTT %.1f us, %.2f MB/s, %d failures", server->name, (unsigned long long) server->transfers,
+               server->smoothedRTT / 1000.0, server->throughput / 1e6, server->failures);
+        if (server->retryAt > now) {
+            printf(", retry in %llu ms", (unsigned long long) ((server->retryAt - now) / 1000000ULL));
+        }
+        printf("\n");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display how many transfers skipped the resolution and the socket setup
+void displaySessionCache() {
+    printf("----- sessionCache -----\n");
+    printf("Resolutions: %llu cached, %llu resolved\n", (unsigned long long) sessionCache.resolverHits,
+           (unsigned long long) sessionCache.resolverMisses);
+    printf("Sockets: %llu pre-created, %llu created on demand\n", (unsigned long long) sessionCache.socketHits,
+           (unsigned long long) sessionCache.socketMisses);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the digest of a transfer (verified is -1 when there is no expected value)
+void displayDigest(const struct Digest *digest, const char *hex, int verified) {
+    const char *name = digest->algorithm == DIGEST_CRC32C ? "CRC32C" : "SHA-256";
+    int hardware = digest->algorithm == DIGEST_CRC32C ? digestCheck.hardwareCRC : digestCheck.hardwareSHA;
+
+    printf("----- digest -----\n");
+    printf("%s: %s (%s, %llu bytes)\n", name, hex, hardware ? "hardware" : "software", (unsigned long long) digest->length);
+    if (verified != -1) {
+        printf("Verified: %s\n", verified ? "yes" : "no");
+        if (!verified) {
+            printf("Expected: %s\n", digestCheck.expected);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the blocks that were not written (get) or read (put) thanks to holes
+void displaySparseStats(const char *label, uint64_t blocks, uint64_t bytes) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- sparseFile -----\n");
+    printf("%s: %llu (%.2f MB)\n", label, (unsigned long long) blocks, bytes / 1e6);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display where the server or relay listens
+void displayDebugServer(const char *host, int workers) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- %s -----\n", relayUpstream != NULL ? "relay" : "server");
+    printf("Listening on %s port %s, %d worker%s\n", host != NULL ? host : "all addresses", clientOptions.listenPort, workers, workers > 1 ? "s" : "");
+    if (relayUpstream != NULL) {
+        printf("Cache: %s, upstream %s:%s\n", serverRoot, relayUpstream, clientOptions.port);
+    } else {
+        printf("Root: %s\n", serverRoot);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display how a request was answered
+void displayDebugRequest(const struct sockaddr *peerAddr, uint16_t opcode, const char *filename, const char *outcome) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    char ipstr[INET6_ADDRSTRLEN];
+    printf("%s %s from %s: %s\n", opcode == OPCODE_RRQ ? "RRQ" : "WRQ", filename, addressToString(peerAddr, ipstr, sizeof ipstr), outcome);
+    fflush(stdout);
+}
+
+// Function to display the requests served by the server or relay (always shown, even with -q)
+void displayServerStats() {
+    printf("----- serverStats -----\n");
+    printf("Requests: %llu (mapped files reused: %llu)\n",
+           (unsigned long long) atomic_load_explicit(&serverStats->requests, memory_order_relaxed),
+           (unsigned long long) atomic_load_explicit(&serverStats->hotHits, memory_order_relaxed));
+    if (relayUpstream != NULL) {
+        printf("Relay: %llu fetches, %llu coalesced\n",
+               (unsigned long long) atomic_load_explicit(&serverStats->fetches, memory_order_relaxed),
+               (unsigned long long) atomic_load_explicit(&serverStats->coalesced, memory_order_relaxed));
+    }
+    printf("Transfers: %llu downloads, %llu uploads, %llu failed\n",
+           (unsigned long long) atomic_load_explicit(&serverStats->downloads, memory_order_relaxed),
+           (unsigned long long) atomic_load_explicit(&serverStats->uploads, memory_order_relaxed),
+           (unsigned long long) atomic_load_explicit(&serverStats->failures, memory_order_relaxed));
+    printf("Data: %.2f MB sent, %.2f MB received\n",
+           atomic_load_explicit(&serverStats->bytesSent, memory_order_relaxed) / 1e6,
+           atomic_load_explicit(&serverStats->bytesReceived, memory_order_relaxed) / 1e6);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display how the content cache served a download
+void displayDebugContentCache(const char *outcome, const char *method) {
+    if (clientOptions.quiet) {
+        return;
+    }
+
+    printf("----- contentCache -----\n");
+    printf("Entry: %s\n", contentCache.path);
+    printf("Outcome: %s%s%s%s\n", outcome, method != NULL ? " (" : "", method != NULL ? method : "", method != NULL ? ")" : "");
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the downloads skipped thanks to the content cache
+void displayContentCache() {
+    printf("----- contentCacheSummary -----\n");
+    printf("Hits: %llu (%.2f MB not transferred)\n", (unsigned long long) contentCache.hits, contentCache.savedBytes / 1e6);
+    printf("Stored: %llu\n", (unsigned long long) contentCache.misses);
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the receive queue drops of the transfer socket (always shown, even with -q, when there were some)
+void displaySocketStats() {
+    if (clientOptions.quiet && socketStats.drops == 0) {
+        return;
+    }
+
+    printf("----- socketStats -----\n");
+    if (socketStats.dropCounter) {
+        printf("Receive Queue Drops: %u\n", socketStats.drops);
+    } else {
+        printf("Receive Queue Drops: not reported by this system\n");
+    }
+    if (socketStats.drops != 0) {
+        printf("Receive Buffer: %d bytes (raise net.core.rmem_max to allow a larger window x blksize)\n", socketStats.receiveBuffer);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Function to display the original and replayed figures of a transfer (always shown, even with -q)
+void displayReplayComparison(int index, const struct ReplayTransfer *transfer, const struct PhaseTimings *timings, const struct LatencyHistogram *latency) {
+    double originalSeconds = (transfer->endTime - transfer->requestTime) / 1e9;
+    double replaySeconds = (timings->marks[PHASE_STEADY] - timings->marks[PHASE_REQUEST]) / 1e9;
+
+    printf("----- replayTrace -----\n");
+    printf("Transfer %d: %s %s (%llu bytes, blksize %s, %d losses)\n", index + 1,
+           transfer->opcode == OPCODE_RRQ ? "get" : "put", transfer->filename,
+           (unsigned long long) transfer->bytes, clientOptions.blockSize, transfer->losses.count);
+    printf("Original: %.3f ms, first response %.1f us, %.2f MB/s, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           originalSeconds * 1e3,
+           transfer->firstResponseTime != 0 ? (transfer->firstResponseTime - transfer->requestTime) / 1000.0 : 0.0,
+           originalSeconds > 0 ? transfer->bytes / originalSeconds / 1e6 : 0.0,
+           latencyPercentile(&transfer->latency, 50.0) / 1000.0,
+           latencyPercentile(&transfer->latency, 99.0) / 1000.0,
+           atomic_load_explicit(&transfer->latency.maxValue, memory_order_relaxed) / 1000.0);
+    printf("Replay: %.3f ms, first response %.1f us, %.2f MB/s, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           replaySeconds * 1e3,
+           (timings->marks[PHASE_FIRST_RESPONSE] - timings->marks[PHASE_REQUEST]) / 1000.0,
+           replaySeconds > 0 ? transfer->bytes / replaySeconds / 1e6 : 0.0,
+           latencyPercentile(latency, 50.0) / 1000.0,
+           latencyPercentile(latency, 99.0) / 1000.0,
+           atomic_load_explicit(&latency->maxValue, memory_order_relaxed) / 1000.0);
+    printf("\n");
+    fflush(stdout);
+}
+
+
+// -------------------- Main -------------------- //
+int main(int argc, char *argv[]) {
+    char *host;
+    char *file;
+    char *action;
+
+    // Start timing before anything else so that startup cost is measured
+    beginPhases();
+
+    // Parse command line arguments
+    parseCmdArgs(argc, argv, &host, &file, &action);
+    markPhase(PHASE_PARSE);
+
+    // Dump the latency histogram on SIGUSR1
+    installStatsSignalHandler();
+
+    // Digest checked for each transfer
+    if (clientOptions.verify != NULL) {
+        prepareDigestCheck(clientOptions.verify);
+    }
+    if (clientOptions.verify != NULL || clientOptions.contentCache != NULL) {
+        detectDigestInstructions();
+    }
+
+    // The digest covers the local file, whose decompressed bytes only the decompressor sees
+    if (clientOptions.verify != NULL && clientOptions.decompress) {
+        handle_error("main", "A digest (-V) cannot be checked on a decompressed download (-z): check the output file instead", NULL);
+    }
+
+    // A stream is consumed by the upload, so it cannot be sent again
+    if (strcmp(action, "put") == 0 && clientOptions.input != NULL && isStream(clientOptions.input) &&
+        (clientOptions.runs > 1 || clientOptions.alternateCount > 0 || clientOptions.clients > 0)) {
+        handle_error("main", "A streamed upload is sent once (without -n, -F or -c)", NULL);
+    }
+
+    // Streaming a download to stdout: the messages go to stderr
+    if (clientOptions.output != NULL && strcmp(clientOptions.output, "-") == 0) {
+        redirectMessages();
+    }
+
+    // Preallocate the capture ring when a pcap file is requested
+    if (clientOptions.capturePath != NULL) {
+        initCaptureRing();
+    }
+
+    // Relay mode: file is the cache directory, host the upstream server
+    if (strcmp(action, "relay") == 0) {
+        runServer(NULL, file, host);
+        return EXIT_SUCCESS;
+    }
+
+    // Server mode: file is the directory served, host the local address (* for all)
+    if (strcmp(action, "serve") == 0) {
+        runServer(strcmp(host, "*") == 0 ? NULL : host, file, NULL);
+        return EXIT_SUCCESS;
+    }
+
+    // A comma-separated host list enables hedged requests across mirrors (downloads only)
+    if (strchr(host, ',') != NULL) {
+        parseMirrors(host);
+        if (strcmp(action, "get") != 0 || clientOptions.clients > 0) {
+            handle_error("main", "Mirror lists are only supported for get (without -c)", NULL);
+        }
+    } else if (strcmp(action, "replay") != 0 && clientOptions.clients == 0) {
+        // Resolve host and the alternates once: the pool is used when alternates are given
+        if (clientOptions.alternateCount > 0) {
+            buildServerPool(host);
+        }
+    }
+
+    // Load mode: the synthetic clients share one resolution and open their own sockets
+    if (clientOptions.clients > 0) {
+        struct addrinfo *serverAddr = getAddressInfo(host, clientOptions.port);
+        runLoad(serverAddr, action, file);
+        cleanup(serverAddr, -1, NULL, NULL);
+        return EXIT_SUCCESS;
+    }
+
+    for (int run = 0; run < clientOptions.runs; run++) {
+        // Later runs reuse the parsed arguments, so their parse phase is empty (their socket is prepared before)
+        if (run > 0) {
+            refillSocketPool();
+            beginPhases();
+            markPhase(PHASE_PARSE);
+        }
+
+        // Hedged get: the mirrors are resolved and asked as needed
+        if (hedgeStats.mirrorCount > 1) {
+            hedgedGet(file);
+            displayPhaseTimings(&currentPhases);
+            addPhaseSummary(&currentPhases);
+            continue;
+        }
+
+        // Server pool: the addresses were resolved once, the transfer goes to the best healthy server
+        if (serverPool.count > 1) {
+            markPhase(PHASE_RESOLVE);
+            runPoolTransfer(action, file);
+            displayPhaseTimings(&currentPhases);
+            addPhaseSummary(&currentPhases);
+            continue;
+        }
+
+        // Get server address information using getaddrinfo
+        struct addrinfo *serverAddr = getAddressInfo(host, clientOptions.port);
+        markPhase(PHASE_RESOLVE);
+
+        // Several addresses (e.g. IPv6 and IPv4): race the request across them
+        if (serverAddr->ai_next != NULL && strcmp(action, "replay") != 0) {
+            happyEyeballs(serverAddr, action, file);
+            displayPhaseTimings(&currentPhases);
+            addPhaseSummary(&currentPhases);
+            continue;
+        }
+
+        // Create and reserve a socket for connection to the server
+        int sockfd = createSocket(serverAddr);
+        markPhase(PHASE_SOCKET);
+
+        // Process user input
+        processUserInput(sockfd, serverAddr, action, file);
+
+        // Report the phases of this transfer and add them to the summary (the replay reports its own figures)
+        if (strcmp(action, "replay") != 0) {
+            displayPhaseTimings(&currentPhases);
+            addPhaseSummary(&currentPhases);
+        }
+    }
+
+    // Display the phase summary of a batch and the per-block latency distribution
+    if (phaseSummary.runs > 1) {
+        displayPhaseSummary(&phaseSummary);
+    }
+    if (hedgeStats.mirrorCount > 1) {
+        displayHedgeSummary();
+    }
+    if (serverPool.count > 1) {
+        displayServerPool();
+    }
+    freeServerPool();
+    if (clientOptions.runs > 1 && clientOptions.sessionTTL > 0) {
+        displaySessionCache();
+    }
+    if (clientOptions.runs > 1 && clientOptions.contentCache != NULL) {
+        displayContentCache();
+    }
+    freeSessionCache();
+    if (strcmp(action, "replay") != 0) {
+        displayLatencyHistogram(&blockLatency);
+        displayWakeupHistogram(&wakeupLatency);
+    }
+
+    // Exit the program successfully
+    return EXIT_SUCCESS;
+}